@@ -0,0 +1,64 @@
+#include "Arena.h"
+#include <algorithm>
+
+namespace tf
+{
+//-----------------------------------------------------------------------------
+// class Arena
+//-----------------------------------------------------------------------------
+Arena::Arena(size_t block_size, BucketProvider* provider)
+  : block_size_(block_size)
+  , provider_(provider ? provider : BucketProvider::defaultProvider())
+{
+    head_ = newBlock(block_size_);
+    reset();
+}
+
+Arena::~Arena()
+{
+    for (Block* block = head_; block; )
+    {
+        Block* next = block->next_;
+        provider_->release(block, sizeof(Block)+block->size_);
+        block = next;
+    }
+}
+
+Arena::Block* Arena::newBlock(size_t size)
+{
+    Block* block = new(provider_->acquire(sizeof(Block)+size)) Block;
+    block->size_ = size;
+    return block;
+}
+
+void* Arena::allocSlow(size_t size, size_t alignment)
+{
+    // Move to the next block, kept from before a reset or a rewind, unless
+    // it is too small. Blocks for large allocations are chained after the
+    // current one so that the following blocks stay in the chain
+    size_t need = size+alignment-1;
+    Block* next = cur_->next_;
+    if (!next || next->size_ < need)
+    {
+        next = newBlock(std::max(block_size_, need));
+        next->next_ = cur_->next_;
+        cur_->next_ = next;
+    }
+    cur_ = next;
+    end_ = next->end();
+    char* p = constAlign(next->begin(), alignment);
+    pos_ = p+size;
+    return p;
+}
+
+size_t Arena::capacity() const
+{
+    size_t capacity = 0;
+    for (Block* block = head_; block; block = block->next_)
+    {
+        capacity += block->size_;
+    }
+    return capacity;
+}
+
+} // name space tf
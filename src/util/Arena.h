@@ -0,0 +1,150 @@
+#pragma once
+
+#include "Platform.h"
+#include "Intrinsics.h"
+#include "BucketProvider.h"
+#include <memory_resource>
+#include <new>
+#include <type_traits>
+
+namespace tf
+{
+
+/**
+ * \class Arena
+ * \ingroup MemPool
+ * \brief A bump pointer allocator over a chain of blocks.
+ * Objects are never freed one by one. reset() releases everything at once
+ * and a Marker taken with mark() releases everything allocated after it,
+ * both in O(1). Blocks are kept across resets and reused, so a warmed up
+ * arena does not allocate memory any more.
+ * Destructors of the objects are not called, so acq() only takes trivially
+ * destructible types. An Arena is used by one thread at a time.
+ */
+class Arena
+{
+    struct Block
+    {
+        Block*      next_ {nullptr};
+        size_t      size_ {0};          // bytes following the block header
+
+        char* begin() { return reinterpret_cast<char*>(this+1); }
+        char* end() { return begin()+size_; }
+    };
+
+  public:
+    constexpr static size_t DEFAULT_ALIGNMENT = 8;
+
+    /// A position in the arena to rewind to
+    struct Marker
+    {
+        Block*      block_;
+        char*       pos_;
+    };
+
+    explicit Arena(size_t block_size = 64*1024, BucketProvider* provider = nullptr)
+        noexcept(false);
+    ~Arena();
+
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    TF_INLINE void* alloc(size_t size, size_t alignment = DEFAULT_ALIGNMENT)
+        noexcept(false)
+    {
+        char* p = constAlign(pos_, alignment);
+        if (TF_LIKELY(p+size <= end_))
+        {
+            pos_ = p+size;
+            return p;
+        }
+        return allocSlow(size, alignment);
+    }
+
+    template <typename T, typename... Args>
+    T* acq(Args... args) noexcept(false)
+    {
+        static_assert(std::is_trivially_destructible<T>::value,
+                      "Arena does not call destructors");
+        return new(alloc(sizeof(T), alignof(T)))T(args...);
+    }
+
+    Marker mark() const { return Marker {cur_, pos_}; }
+
+    /// Releases everything allocated after the marker was taken
+    void rewind(const Marker& marker)
+    {
+        cur_ = marker.block_;
+        pos_ = marker.pos_;
+        end_ = cur_->end();
+    }
+
+    /// Releases everything allocated from the arena, keeping the blocks
+    void reset()
+    {
+        cur_ = head_;
+        pos_ = head_->begin();
+        end_ = head_->end();
+    }
+
+    /// Returns the bytes held in blocks
+    size_t capacity() const;
+
+    /// Rewinds the arena to its current position when going out of scope
+    class Scope
+    {
+      public:
+        explicit Scope(Arena& arena): arena_(arena), marker_(arena.mark()) {}
+        ~Scope() { arena_.rewind(marker_); }
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+      private:
+        Arena&      arena_;
+        Marker      marker_;
+    };
+
+  private:
+    void* allocSlow(size_t size, size_t alignment) noexcept(false);
+    Block* newBlock(size_t size) noexcept(false);
+
+    size_t              block_size_;
+    BucketProvider*     provider_;
+    Block*              head_ {nullptr};
+    Block*              cur_ {nullptr};
+    char*               pos_ {nullptr};
+    char*               end_ {nullptr};
+};
+
+//-----------------------------------------------------------------------------
+/**
+ * \class ArenaResource
+ * \ingroup MemPool
+ * \brief A std::pmr::memory_resource allocating from an Arena.
+ * Deallocation is a no-op, the memory comes back when the arena is reset
+ * or rewound. The containers using it must not outlive that.
+ */
+class ArenaResource: public std::pmr::memory_resource
+{
+  public:
+    explicit ArenaResource(Arena& arena): arena_(arena) {}
+
+    Arena& arena() const { return arena_; }
+
+  protected:
+    void* do_allocate(size_t bytes, size_t alignment) override
+    { return arena_.alloc(bytes, alignment); }
+
+    void do_deallocate(void*, size_t, size_t) override {}
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override
+    {
+        const ArenaResource* rhs = dynamic_cast<const ArenaResource*>(&other);
+        return rhs && &rhs->arena_ == &arena_;
+    }
+
+    Arena&      arena_;
+};
+
+} // name space tf
@@ -0,0 +1,280 @@
+#include "BucketProvider.h"
+#include "Intrinsics.h"
+#include <algorithm>      // for max
+#include <cstdint>        // for uintptr_t
+#include <cstdlib>        // for malloc, aligned_alloc and free
+#include <stdexcept>      // for runtime_error
+#include <string>         // for string used by runtime_error
+
+#if (TF_OS_FAMILY==TF_OS_FAMILY_LINUX)
+    #include <unistd.h>
+    #include <sys/mman.h>
+    #include <sys/syscall.h>
+#endif
+
+namespace tf
+{
+//-----------------------------------------------------------------------------
+// class BucketProvider
+//-----------------------------------------------------------------------------
+void* BucketProvider::acquire(size_t size, size_t alignment)
+{
+    void* bucket = allocBucket(size, alignment);
+    if ((reinterpret_cast<uintptr_t>(bucket) & (alignment-1)) != 0)
+    {
+        freeBucket(bucket, size);
+        throw std::runtime_error(std::string("BucketProvider::acquire: bucket not aligned"));
+    }
+    if (prefault_)
+    {
+        touchPages(bucket, size);
+    }
+    return bucket;
+}
+
+void BucketProvider::touchPages(void* p, size_t size)
+{
+    constexpr size_t PAGE_SIZE = 4096;
+    volatile char* cp = reinterpret_cast<volatile char*>(p);
+    volatile char* end = cp + size;
+    // Writing back the value read keeps the content, such as free list
+    // links, and still makes the kernel map a writable page
+    for (; cp < end; cp += PAGE_SIZE)
+    {
+        *cp = *cp;
+    }
+    if (size > 0)
+    {
+        *(end-1) = *(end-1);
+    }
+}
+
+#if (TF_OS_FAMILY==TF_OS_FAMILY_LINUX)
+void BucketProvider::lockPages(void* p, size_t size)
+{
+    if (::mlock(p, size) != 0)
+    {
+        throw std::runtime_error(std::string("BucketProvider::lockPages: mlock failed"));
+    }
+}
+
+void BucketProvider::unlockPages(void* p, size_t size)
+{
+    ::munlock(p, size);
+}
+
+void BucketProvider::discard(void* bucket, size_t size)
+{
+    // Only whole pages inside the bucket can be dropped, the pages at the
+    // ends may be shared with other malloc blocks
+    size_t page_size = size_t(::sysconf(_SC_PAGESIZE));
+    char* start = constAlign(static_cast<char*>(bucket), page_size);
+    char* end = static_cast<char*>(bucket) + size;
+    end -= intptr_t(end) & (page_size-1);
+    if (end > start)
+    {
+        ::madvise(start, end-start, MADV_DONTNEED);
+    }
+}
+#else
+void BucketProvider::lockPages(void*, size_t)
+{
+}
+
+void BucketProvider::unlockPages(void*, size_t)
+{
+}
+
+void BucketProvider::discard(void*, size_t)
+{
+}
+#endif
+
+// malloc only aligns to 16, larger alignments go to aligned_alloc, whose
+// size must be a multiple of the alignment. Both are released with free
+static void* mallocAligned(size_t size, size_t alignment)
+{
+    return alignment <= 16 ? ::malloc(size)
+                           : std::aligned_alloc(alignment, constAlign(size, alignment));
+}
+
+#if (TF_OS_FAMILY==TF_OS_FAMILY_LINUX)
+// Maps size bytes aligned to alignment. mmap aligns to its page size only,
+// so for a larger alignment the mapping is made larger and trimmed at both
+// ends. The trimmed mapping is released with munmap of size bytes
+static void* mapAligned(size_t size, size_t alignment, size_t page_size, int flags)
+{
+    size_t extra = alignment > page_size ? alignment : 0;
+    void* p = ::mmap(nullptr, size+extra, PROT_READ | PROT_WRITE, flags, -1, 0);
+    if (p == MAP_FAILED || extra == 0)
+    {
+        return p;
+    }
+    char* base = static_cast<char*>(p);
+    char* bucket = constAlign(base, alignment);
+    if (bucket > base)
+    {
+        ::munmap(base, bucket-base);
+    }
+    if (bucket < base+extra)
+    {
+        ::munmap(bucket+size, base+extra-bucket);
+    }
+    return bucket;
+}
+#endif
+
+BucketProvider* BucketProvider::defaultProvider()
+{
+    // Never destroyed, so that pools in static objects such as MemPool can
+    // still release their buckets during static destruction
+    static MallocBucketProvider* s_provider = new MallocBucketProvider;
+    return s_provider;
+}
+
+//-----------------------------------------------------------------------------
+// class MallocBucketProvider
+//-----------------------------------------------------------------------------
+void* MallocBucketProvider::allocBucket(size_t size, size_t alignment)
+{
+    void* bucket = mallocAligned(size, alignment);
+    if (!bucket)
+    {
+        throw std::runtime_error(std::string("MallocBucketProvider::allocBucket: memory full"));
+    }
+    return bucket;
+}
+
+void MallocBucketProvider::freeBucket(void* bucket, size_t)
+{
+    ::free(bucket);
+}
+
+#if (TF_OS_FAMILY==TF_OS_FAMILY_LINUX)
+//-----------------------------------------------------------------------------
+// class HugePageBucketProvider
+//-----------------------------------------------------------------------------
+void* HugePageBucketProvider::allocBucket(size_t size, size_t alignment)
+{
+    size_t map_size = constAlign(size, HUGE_PAGE_SIZE);
+    void* bucket = MAP_FAILED;
+    if (!transparent_)
+    {
+        bucket = mapAligned(map_size, alignment, HUGE_PAGE_SIZE,
+                            MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB);
+    }
+    if (bucket == MAP_FAILED)
+    {
+        // No reserved huge page left, fall back to transparent huge pages.
+        // Only a huge page aligned range holds whole huge pages
+        bucket = mapAligned(map_size, std::max(alignment, HUGE_PAGE_SIZE),
+                            size_t(::sysconf(_SC_PAGESIZE)),
+                            MAP_PRIVATE | MAP_ANONYMOUS);
+        if (bucket == MAP_FAILED)
+        {
+            throw std::runtime_error(std::string("HugePageBucketProvider::allocBucket: memory full"));
+        }
+        ::madvise(bucket, map_size, MADV_HUGEPAGE);
+    }
+    return bucket;
+}
+
+void HugePageBucketProvider::freeBucket(void* bucket, size_t size)
+{
+    ::munmap(bucket, constAlign(size, HUGE_PAGE_SIZE));
+}
+
+void HugePageBucketProvider::discard(void* bucket, size_t size)
+{
+    // Huge page mappings can only be dropped in whole huge pages
+    ::madvise(bucket, constAlign(size, HUGE_PAGE_SIZE), MADV_DONTNEED);
+}
+
+//-----------------------------------------------------------------------------
+// class NumaBucketProvider
+//-----------------------------------------------------------------------------
+void* NumaBucketProvider::allocBucket(size_t size, size_t alignment)
+{
+    // Use the mbind system call directly to avoid depending on libnuma
+    constexpr int MPOL_BIND_MODE = 2;
+    constexpr size_t MAX_NODE = sizeof(unsigned long)*8;
+
+    if (numa_node_ < 0 || size_t(numa_node_) >= MAX_NODE)
+    {
+        throw std::runtime_error(std::string("NumaBucketProvider::allocBucket: invalid numa node"));
+    }
+    size_t page_size = size_t(::sysconf(_SC_PAGESIZE));
+    size_t map_size = huge_page_
+        ? constAlign(size, HugePageBucketProvider::HUGE_PAGE_SIZE)
+        : constAlign(size, page_size);
+    if (huge_page_)
+    {
+        alignment = std::max(alignment, HugePageBucketProvider::HUGE_PAGE_SIZE);
+    }
+    void* bucket = mapAligned(map_size, alignment, page_size,
+                              MAP_PRIVATE | MAP_ANONYMOUS);
+    if (bucket == MAP_FAILED)
+    {
+        throw std::runtime_error(std::string("NumaBucketProvider::allocBucket: memory full"));
+    }
+    if (huge_page_)
+    {
+        ::madvise(bucket, map_size, MADV_HUGEPAGE);
+    }
+    unsigned long node_mask = 1UL << numa_node_;
+    if (::syscall(SYS_mbind, bucket, map_size, MPOL_BIND_MODE,
+                  &node_mask, MAX_NODE+1, 0) != 0)
+    {
+        ::munmap(bucket, map_size);
+        throw std::runtime_error(std::string("NumaBucketProvider::allocBucket: mbind failed"));
+    }
+    return bucket;
+}
+
+void NumaBucketProvider::freeBucket(void* bucket, size_t size)
+{
+    size_t map_size = huge_page_
+        ? constAlign(size, HugePageBucketProvider::HUGE_PAGE_SIZE)
+        : constAlign(size, size_t(::sysconf(_SC_PAGESIZE)));
+    ::munmap(bucket, map_size);
+}
+
+#else
+// Huge pages and NUMA binding are only supported on Linux, other platforms
+// get plain malloc buckets
+void* HugePageBucketProvider::allocBucket(size_t size, size_t alignment)
+{
+    void* bucket = mallocAligned(size, alignment);
+    if (!bucket)
+    {
+        throw std::runtime_error(std::string("HugePageBucketProvider::allocBucket: memory full"));
+    }
+    return bucket;
+}
+
+void HugePageBucketProvider::freeBucket(void* bucket, size_t)
+{
+    ::free(bucket);
+}
+
+void HugePageBucketProvider::discard(void*, size_t)
+{
+}
+
+void* NumaBucketProvider::allocBucket(size_t size, size_t alignment)
+{
+    void* bucket = mallocAligned(size, alignment);
+    if (!bucket)
+    {
+        throw std::runtime_error(std::string("NumaBucketProvider::allocBucket: memory full"));
+    }
+    return bucket;
+}
+
+void NumaBucketProvider::freeBucket(void* bucket, size_t)
+{
+    ::free(bucket);
+}
+#endif
+
+} // name space tf
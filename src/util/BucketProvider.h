@@ -0,0 +1,129 @@
+#pragma once
+
+#include "Platform.h"
+#include <stddef.h>
+
+namespace tf
+{
+
+/**
+ * \class BucketProvider
+ * \ingroup MemPool
+ * \brief Supplies the memory backing FixedMemPool buckets.
+ * A pool asks its provider for a bucket with acquire() and gives it back
+ * with release() when the pool is destroyed. A provider is not owned by
+ * the pools using it and must outlive them.
+ * Buckets are aligned by the provider rather than padded by the pool, so
+ * that buckets aligned to PageMap slabs take no extra memory.
+ * When prefault is set, every page of a new bucket is touched before it is
+ * handed to the pool, so the first allocation from the bucket never takes a
+ * page fault on the hot path.
+ */
+class BucketProvider
+{
+  public:
+    explicit BucketProvider(bool prefault = false): prefault_(prefault) {}
+    virtual ~BucketProvider() = default;
+
+    /// Returns a bucket of size bytes aligned to alignment, a power of two
+    void* acquire(size_t size, size_t alignment = 16) noexcept(false);
+    void release(void* bucket, size_t size) { freeBucket(bucket, size); }
+
+    /// Gives the physical pages of an unused bucket back to the OS while
+    /// keeping its address range. The pages are zero filled when touched
+    /// again. Pages locked in memory are kept, so unlock them first
+    virtual void discard(void* bucket, size_t size);
+
+    bool isPrefault() const { return prefault_; }
+
+    /// Touches every page in the given memory without changing its content
+    static void touchPages(void* p, size_t size);
+
+    /// Locks the pages of the given memory in RAM with mlock, so that they
+    /// are never swapped out. Throws when the lock limit is exceeded
+    static void lockPages(void* p, size_t size) noexcept(false);
+    static void unlockPages(void* p, size_t size);
+
+    /// The provider used by pools that are not given one, backed by malloc
+    static BucketProvider* defaultProvider();
+
+  protected:
+    virtual void* allocBucket(size_t size, size_t alignment) noexcept(false) = 0;
+    virtual void freeBucket(void* bucket, size_t size) = 0;
+
+    const bool      prefault_;
+};
+
+//-----------------------------------------------------------------------------
+class MallocBucketProvider: public BucketProvider
+{
+  public:
+    explicit MallocBucketProvider(bool prefault = false)
+      : BucketProvider(prefault) {}
+
+  protected:
+    void* allocBucket(size_t size, size_t alignment) noexcept(false) override;
+    void freeBucket(void* bucket, size_t size) override;
+};
+
+//-----------------------------------------------------------------------------
+/**
+ * \class HugePageBucketProvider
+ * \brief Backs buckets with 2MB pages to cut TLB misses.
+ * By default buckets are mapped with MAP_HUGETLB from the reserved huge page
+ * pool (vm.nr_hugepages). When the reserved pool is exhausted, or when
+ * transparent is set, the bucket is mapped with normal pages and advised
+ * with MADV_HUGEPAGE so that the kernel backs it with transparent huge
+ * pages. Bucket sizes are rounded up to the huge page size, so size
+ * entry_num_per_bucket to fill whole huge pages.
+ */
+class HugePageBucketProvider: public BucketProvider
+{
+  public:
+    constexpr static size_t HUGE_PAGE_SIZE = 2*1024*1024;
+
+    explicit HugePageBucketProvider(bool prefault = false, bool transparent = false)
+      : BucketProvider(prefault), transparent_(transparent) {}
+
+  protected:
+    void* allocBucket(size_t size, size_t alignment) noexcept(false) override;
+    void freeBucket(void* bucket, size_t size) override;
+
+  public:
+    void discard(void* bucket, size_t size) override;
+
+  protected:
+    const bool      transparent_;
+};
+
+//-----------------------------------------------------------------------------
+/**
+ * \class NumaBucketProvider
+ * \brief Backs buckets with memory bound to a given NUMA node.
+ * Buckets are mapped anonymously and bound to the node with mbind before
+ * any page is touched, so the pages are always allocated on that node.
+ * Set huge_page to also map the bucket with transparent huge pages.
+ */
+class NumaBucketProvider: public BucketProvider
+{
+  public:
+    explicit NumaBucketProvider(
+        int numa_node,
+        bool prefault = false,
+        bool huge_page = false
+    ) : BucketProvider(prefault)
+      , numa_node_(numa_node)
+      , huge_page_(huge_page)
+    {}
+
+    int numaNode() const { return numa_node_; }
+
+  protected:
+    void* allocBucket(size_t size, size_t alignment) noexcept(false) override;
+    void freeBucket(void* bucket, size_t size) override;
+
+    const int       numa_node_;
+    const bool      huge_page_;
+};
+
+} // name space tf
@@ -0,0 +1,194 @@
+#include "EpochDomain.h"
+#include <thread>         // for yield
+
+#if (TF_OS_FAMILY==TF_OS_FAMILY_LINUX)
+    #include <linux/membarrier.h>
+    #include <sys/syscall.h>
+    #include <unistd.h>
+#endif
+
+namespace tf
+{
+//-----------------------------------------------------------------------------
+// class EpochDomain
+//-----------------------------------------------------------------------------
+thread_local EpochDomain::ThreadRecord* EpochDomain::t_record_ = nullptr;
+
+// Gives the record of a thread back to the domain when the thread exits
+struct EpochThreadExit
+{
+    EpochDomain::ThreadRecord* record_ {nullptr};
+    ~EpochThreadExit()
+    {
+        if (record_)
+        {
+            EpochDomain::instance().unregisterThread(record_);
+        }
+    }
+};
+
+namespace
+{
+thread_local EpochThreadExit s_thread_exit;
+}
+
+EpochDomain& EpochDomain::instance()
+{
+    // Never destroyed, threads may exit during static destruction
+    static EpochDomain* s_domain = new EpochDomain;
+    return *s_domain;
+}
+
+EpochDomain::EpochDomain()
+{
+#if (TF_OS_FAMILY==TF_OS_FAMILY_LINUX)
+    asymmetric_ = ::syscall(SYS_membarrier,
+                            MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED, 0, 0) == 0;
+#endif
+}
+
+EpochDomain::ThreadRecord* EpochDomain::registerThread()
+{
+    ThreadRecord* record = records_.load(std::memory_order_acquire);
+    for (; record; record = record->next_)
+    {
+        bool in_use = false;
+        if (!record->in_use_.load(std::memory_order_relaxed) &&
+            record->in_use_.compare_exchange_strong(in_use, true,
+                                                    std::memory_order_acquire))
+        {
+            break;
+        }
+    }
+    if (!record)
+    {
+        // Records are never freed, so the list is only ever pushed to
+        record = new ThreadRecord;
+        ThreadRecord* head = records_.load(std::memory_order_relaxed);
+        do
+        {
+            record->next_ = head;
+        }
+        while (!records_.compare_exchange_weak(head, record,
+                    std::memory_order_release, std::memory_order_relaxed));
+    }
+    t_record_ = record;
+    s_thread_exit.record_ = record;
+    return record;
+}
+
+void EpochDomain::unregisterThread(ThreadRecord* record)
+{
+    if (record->retired_num_ > 0)
+    {
+        synchronize();
+    }
+    record->nesting_ = 0;
+    record->epoch_.store(0, std::memory_order_release);
+    t_record_ = nullptr;
+    record->in_use_.store(false, std::memory_order_release);
+}
+
+// Moves the global epoch forward when every active reader has announced
+// the current one
+bool EpochDomain::tryAdvance()
+{
+    uint64_t epoch = global_epoch_.load(std::memory_order_acquire);
+#if (TF_OS_FAMILY==TF_OS_FAMILY_LINUX)
+    if (asymmetric_)
+    {
+        // Makes the announcements of the readers visible, standing in for
+        // the fence they skip in enter()
+        ::syscall(SYS_membarrier, MEMBARRIER_CMD_PRIVATE_EXPEDITED, 0, 0);
+    }
+    else
+#endif
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+    }
+    for (ThreadRecord* record = records_.load(std::memory_order_acquire);
+         record; record = record->next_)
+    {
+        uint64_t announced = record->epoch_.load(std::memory_order_acquire);
+        if ((announced & ACTIVE) && (announced >> 1) != epoch)
+        {
+            return false;
+        }
+    }
+    return global_epoch_.compare_exchange_strong(epoch, epoch+1,
+                                                 std::memory_order_acq_rel);
+}
+
+void EpochDomain::freeLimbo(std::vector<Retired>& limbo)
+{
+    // Consecutive entries of the same pool are freed as one batch
+    constexpr size_t MAX_BATCH = 64;
+    void* entries[MAX_BATCH];
+    size_t n = 0;
+    for (size_t i=0; i<limbo.size(); ++i)
+    {
+        const Retired& retired = limbo[i];
+        entries[n++] = retired.entry_;
+        if (n == MAX_BATCH || i+1 == limbo.size() ||
+            limbo[i+1].pool_ != retired.pool_ ||
+            limbo[i+1].free_func_ != retired.free_func_)
+        {
+            retired.free_func_(retired.pool_, entries, n);
+            n = 0;
+        }
+    }
+    limbo.clear();
+}
+
+void EpochDomain::reclaim(ThreadRecord* record)
+{
+    uint64_t epoch = global_epoch_.load(std::memory_order_acquire);
+    for (size_t i=0; i<3; ++i)
+    {
+        std::vector<Retired>& limbo = record->limbo_[i];
+        if (!limbo.empty() && record->limbo_epoch_[i]+2 <= epoch)
+        {
+            record->retired_num_ -= limbo.size();
+            freeLimbo(limbo);
+        }
+    }
+}
+
+void EpochDomain::retire(void* p, void* pool, FreeFunc free_func)
+{
+    ThreadRecord* record = threadRecord();
+    uint64_t epoch = global_epoch_.load(std::memory_order_acquire);
+    size_t index = epoch % 3;
+    std::vector<Retired>& limbo = record->limbo_[index];
+    if (record->limbo_epoch_[index] != epoch)
+    {
+        // Left over from epoch-3 or before, safe by now
+        record->retired_num_ -= limbo.size();
+        freeLimbo(limbo);
+        record->limbo_epoch_[index] = epoch;
+    }
+    limbo.push_back(Retired {p, pool, free_func});
+    if (++record->retired_num_ >= record->next_advance_)
+    {
+        tryAdvance();
+        reclaim(record);
+        // A reader stuck in an old epoch fails every advance, and each one
+        // may cost a membarrier on every CPU, so retry once per batch only
+        record->next_advance_ = record->retired_num_ + RECLAIM_BATCH;
+    }
+}
+
+void EpochDomain::synchronize()
+{
+    ThreadRecord* record = threadRecord();
+    while (record->retired_num_ > 0)
+    {
+        if (!tryAdvance())
+        {
+            std::this_thread::yield();
+        }
+        reclaim(record);
+    }
+}
+
+} // name space tf
@@ -0,0 +1,176 @@
+#pragma once
+
+#include "Platform.h"
+#include "FixedMemPool.h"
+#include <atomic>
+#include <type_traits>
+#include <vector>
+
+namespace tf
+{
+
+/**
+ * \class EpochDomain
+ * \ingroup MemPool
+ * \brief Epoch based reclamation of pool entries used by lock-free code.
+ * A reader accesses shared nodes between enter() and exit(), usually with
+ * an EpochGuard. A writer that unlinks a node hands it to retire() instead
+ * of freeing it, and the node goes back to its pool once every reader that
+ * could still see it has left its critical section.
+ * Each thread announces the global epoch it read in its own record. The
+ * global epoch only moves forward when every active reader has announced
+ * it, so an entry retired in epoch E is safe once the global epoch is E+2.
+ * Retired entries are kept in per thread lists and are freed in batches,
+ * by the retiring thread, with freeN when the pool supports it. So an
+ * entry of a single threaded FixedMemPool must be retired on the thread
+ * that owns the pool. A thread frees all of its retired entries before
+ * it exits.
+ * On Linux, the reclaiming side issues membarrier() so that enter() is a
+ * plain store to the thread's record with no fence. Elsewhere enter()
+ * takes a full fence.
+ */
+class EpochDomain
+{
+  public:
+    using FreeFunc = void (*)(void* pool, void** entries, size_t n);
+
+    /// Number of retired entries that makes a thread try to reclaim, and
+    /// that it retires between two tries
+    constexpr static size_t RECLAIM_BATCH = 64;
+
+    static EpochDomain& instance();
+
+    TF_INLINE void enter()
+    {
+        ThreadRecord* record = threadRecord();
+        if (record->nesting_++ == 0)
+        {
+            record->epoch_.store(
+                (global_epoch_.load(std::memory_order_relaxed) << 1) | ACTIVE,
+                std::memory_order_relaxed);
+            if (asymmetric_)
+            {
+                std::atomic_signal_fence(std::memory_order_seq_cst);
+            }
+            else
+            {
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+            }
+        }
+    }
+
+    TF_INLINE void exit()
+    {
+        ThreadRecord* record = threadRecord();
+        if (--record->nesting_ == 0)
+        {
+            record->epoch_.store(0, std::memory_order_release);
+        }
+    }
+
+    /// Frees the entry to pool once no reader can hold it. The destructor
+    /// of the object in the entry is not called
+    template <class Pool>
+    void retire(void* p, Pool* pool) noexcept(false)
+    {
+        retire(p, pool, &freeEntries<Pool>);
+    }
+
+    void retire(void* p, void* pool, FreeFunc free_func) noexcept(false);
+
+    /// Waits until every entry retired by the calling thread is freed. Must
+    /// not be called between enter() and exit()
+    void synchronize() noexcept(false);
+
+    uint64_t epoch() const { return global_epoch_.load(std::memory_order_relaxed); }
+
+  private:
+    struct Retired
+    {
+        void*       entry_;
+        void*       pool_;
+        FreeFunc    free_func_;
+    };
+
+    struct ThreadRecord
+    {
+        alignas(CPUInfo::cache_alignment_)
+        std::atomic<uint64_t>   epoch_ {0};         // epoch << 1 | ACTIVE
+        alignas(CPUInfo::cache_alignment_)
+        uint32_t                nesting_ {0};
+        std::atomic<bool>       in_use_ {true};
+        ThreadRecord*           next_ {nullptr};
+        std::vector<Retired>    limbo_[3];          // indexed by epoch % 3
+        uint64_t                limbo_epoch_[3] {0, 0, 0};
+        size_t                  retired_num_ {0};
+        size_t                  next_advance_ {RECLAIM_BATCH};  // of retired_num_
+    };
+
+    constexpr static uint64_t ACTIVE = 1;
+
+    EpochDomain();
+    ~EpochDomain() = delete;
+
+    TF_INLINE ThreadRecord* threadRecord()
+    {
+        return TF_LIKELY(t_record_ != nullptr) ? t_record_ : registerThread();
+    }
+
+    ThreadRecord* registerThread() noexcept(false);
+    void unregisterThread(ThreadRecord* record);
+    bool tryAdvance();
+    void reclaim(ThreadRecord* record);
+    static void freeLimbo(std::vector<Retired>& limbo);
+
+    template <class Pool>
+    static void freeEntries(void* pool, void** entries, size_t n)
+    {
+        if constexpr (std::is_base_of<OwnedFixedMemPool, Pool>::value)
+        {
+            static_cast<OwnedFixedMemPool*>(static_cast<Pool*>(pool))->freeN(entries, n);
+        }
+        else if constexpr (std::is_base_of<FixedMemPool, Pool>::value)
+        {
+            static_cast<FixedMemPool*>(static_cast<Pool*>(pool))->freeN(entries, n);
+        }
+        else
+        {
+            for (size_t i=0; i<n; ++i) static_cast<Pool*>(pool)->free(entries[i]);
+        }
+    }
+
+    friend struct EpochThreadExit;
+    static thread_local ThreadRecord*   t_record_;
+
+    alignas(CPUInfo::cache_alignment_)
+    std::atomic<uint64_t>               global_epoch_ {1};
+    alignas(CPUInfo::cache_alignment_)
+    std::atomic<ThreadRecord*>          records_ {nullptr};
+    bool                                asymmetric_ {false};
+};
+
+//-----------------------------------------------------------------------------
+/**
+ * \class EpochGuard
+ * \ingroup MemPool
+ * \brief Keeps the calling thread in an EpochDomain critical section for
+ * the lifetime of the guard.
+ */
+class EpochGuard
+{
+  public:
+    explicit EpochGuard(EpochDomain& domain = EpochDomain::instance())
+      : domain_(domain)
+    {
+        domain_.enter();
+    }
+    ~EpochGuard() { domain_.exit(); }
+
+    EpochGuard(const EpochGuard&) = delete;
+    EpochGuard& operator=(const EpochGuard&) = delete;
+
+  private:
+    EpochDomain&    domain_;
+};
+
+} // name space tf
@@ -1,5 +1,7 @@
 #include "FixedMemPool.h"
-#include <cstdlib>        // for malloc and free
+#include <algorithm>      // for sort and upper_bound
+#include <iomanip>        // for setw
+#include <ostream>        // for ostream used by dumpStats
 #include <stdexcept>      // for runtime_error
 #include <string>         // for string used by runtime_error
 
@@ -18,7 +20,7 @@ struct FixedMemPool::EntryHeader
         {
             uint64_t        magic_word_   : 16;  // 0XA3C5
             uint64_t        bin_          : 16;
-            uint64_t        ref_count_    : 32;
+            uint64_t        ref_count_    : 32;  // see refCount()
         }
         header_struct_;
     };
@@ -36,11 +38,33 @@ struct FixedMemPool::EntryHeader
     }
 };
 
-FixedMemPool::FixedMemPool(size_t value_size, size_t entry_num_per_bucket, bool lazy_alloc)
+FixedMemPool::FixedMemPool(
+    size_t value_size,
+    size_t entry_num_per_bucket,
+    bool lazy_alloc,
+    BucketProvider* provider,
+    size_t alignment,
+    [[maybe_unused]] bool headerless
+)
     : value_size_(value_size)
-    , entry_size_ (sizeof(EntryHeader)+constAlign(value_size,8))
+    , alignment_(alignment > 8 ? alignment : 8)
+#ifdef NDEBUG
+    , header_size_(headerless ? 0 : sizeof(EntryHeader))
+#else
+    , header_size_(sizeof(EntryHeader))
+#endif
+    // The header of an entry sits in the tail padding of the previous one
+    // when the alignment is larger than the header
+    , entry_size_ (constAlign(header_size_+(value_size > 8 ? value_size : 8), alignment_))
+    , value_offset_(header_size_ == 0 ? 0 : alignment_)
     , entry_num_per_bucket_(entry_num_per_bucket)
+    , provider_(provider ? provider : BucketProvider::defaultProvider())
 { 
+    if ((alignment_ & (alignment_-1)) != 0)
+    {
+        throw std::runtime_error(std::string("FixedMemPool: alignment must be a power of two"));
+    }
+    setBucketAlignment(alignment_);
     if (!lazy_alloc)
     {  
         head_ = newBucket();
@@ -51,8 +75,43 @@ FixedMemPool::~FixedMemPool()
 {
     for (auto bucket: bucket_list_)
     {
-        ::free(bucket);
+        releaseBucket(bucket);
+    }
+    for (auto bucket: idle_bucket_list_)
+    {
+        releaseBucket(bucket);
+    }
+}
+
+void FixedMemPool::setBucketAlignment(size_t bucket_alignment)
+{
+    // The provider aligns the buckets, so they need no padding
+    bucket_alignment_ = bucket_alignment;
+    bucket_size_ = entry_size_*entry_num_per_bucket_ + value_offset_ - header_size_;
+}
+
+void FixedMemPool::usePageMap(PageMap* page_map, uint16_t value)
+{
+    if (!bucket_list_.empty() || !idle_bucket_list_.empty())
+    {
+        throw std::runtime_error(std::string("FixedMemPool::usePageMap: pool in use"));
+    }
+    page_map_ = page_map;
+    page_value_ = value;
+    setBucketAlignment(std::max(alignment_, PageMap::SLAB_SIZE));
+}
+
+void FixedMemPool::releaseBucket(void* bucket)
+{
+    if (lock_buckets_)
+    {
+        BucketProvider::unlockPages(bucket, bucket_size_);
     }
+    if (page_map_)
+    {
+        page_map_->clear(bucket, bucket_size_);
+    }
+    provider_->release(bucket, bucket_size_);
 }
 
 void* FixedMemPool::alloc(uint16_t bin)
@@ -64,43 +123,583 @@ void* FixedMemPool::alloc(uint16_t bin)
 
     EntryHeader* cur_head = head_;
     head_ = cur_head->next_free_entry_;
-    cur_head->setAllocated(bin);
-    return cur_head+1;
+    if (header_size_)
+    {
+        cur_head->setAllocated(bin);
+    }
+    --free_num_;
+    stats_.onAlloc();
+    return reinterpret_cast<uint8_t*>(cur_head) + header_size_;
 }
 
 void FixedMemPool::free(void* p)
 {
-    EntryHeader* cur_head = reinterpret_cast<EntryHeader*>(p) - 1;
+    EntryHeader* cur_head =
+        reinterpret_cast<EntryHeader*>(static_cast<uint8_t*>(p) - header_size_);
 
-    if (EntryHeader::MAGIC_WORD != cur_head->header_struct_.magic_word_)
+    if (header_size_ &&
+        EntryHeader::MAGIC_WORD != cur_head->header_struct_.magic_word_)
     {
         throw std::runtime_error(std::string("FixedMemPool::free: memory currupted"));
     }
 
     cur_head->next_free_entry_ = head_;
     head_ = cur_head;
+    stats_.onFree();
+    if (TF_UNLIKELY(++free_num_ > trim_trigger_))
+    {
+        trim(trim_strategy_);
+    }
+}
+
+uint16_t FixedMemPool::entryBin(const void* p)
+{
+    const EntryHeader* cur_head = reinterpret_cast<const EntryHeader*>(p) - 1;
+
+    if (EntryHeader::MAGIC_WORD != cur_head->header_struct_.magic_word_)
+    {
+        throw std::runtime_error(std::string("FixedMemPool::entryBin: memory currupted"));
+    }
+    return cur_head->header_struct_.bin_;
 }
 
-FixedMemPool::EntryHeader* FixedMemPool::newBucket()
+void FixedMemPool::allocN(void** out, size_t n, uint16_t bin)
 {
-    void* bucket = ::malloc(entry_size_*entry_num_per_bucket_);
-    if (!bucket)
+    // All the buckets are made before any entry is taken, so that a
+    // provider failure leaves the free list as it was
+    if (TF_UNLIKELY(free_num_ < n))
     {
-        throw std::runtime_error(std::string("FixedMemPool::newBucket: memory full"));
+        reserve(n);
     }
-    uint8_t* p = reinterpret_cast<uint8_t*>(bucket);
+    EntryHeader* entry = head_;
+    for (size_t i=0; i<n; ++i)
+    {
+        EntryHeader* next = entry->next_free_entry_;
+        if (header_size_)
+        {
+            entry->setAllocated(bin);
+        }
+        out[i] = reinterpret_cast<uint8_t*>(entry) + header_size_;
+        entry = next;
+    }
+    head_ = entry;
+    free_num_ -= n;
+    stats_.onAlloc(n);
+}
+
+void FixedMemPool::freeN(void** in, size_t n)
+{
+    if (n == 0)
+    {
+        return;
+    }
+    EntryHeader* next = head_;
+    for (size_t i=n; i>0; --i)
+    {
+        EntryHeader* cur_head = reinterpret_cast<EntryHeader*>(
+            static_cast<uint8_t*>(in[i-1]) - header_size_);
+        if (header_size_ &&
+            EntryHeader::MAGIC_WORD != cur_head->header_struct_.magic_word_)
+        {
+            // Keep the entries linked so far
+            head_ = next;
+            throw std::runtime_error(std::string("FixedMemPool::freeN: memory currupted"));
+        }
+        cur_head->next_free_entry_ = next;
+        next = cur_head;
+        ++free_num_;
+        stats_.onFree();
+    }
+    head_ = next;
+    if (TF_UNLIKELY(free_num_ > trim_trigger_))
+    {
+        trim(trim_strategy_);
+    }
+}
+
+// Makes bucket_num buckets and returns their entries as one list. When a
+// bucket cannot be made, the ones made before it are released
+FixedMemPool::EntryHeader* FixedMemPool::newBucket(size_t bucket_num)
+{
+    EntryHeader* first = nullptr;
+    bucket_list_.reserve(bucket_list_.size() + bucket_num);
+    size_t b = 0;
+    try
+    {
+        for (; b<bucket_num; ++b)
+        {
+            first = linkBucket(makeBucket(), first);
+        }
+    }
+    catch (...)
+    {
+        for (; b>0; --b)
+        {
+            releaseBucket(bucket_list_.back());
+            bucket_list_.pop_back();
+        }
+        throw;
+    }
+    free_num_ += bucket_num*entry_num_per_bucket_;
+    for (b=0; b<bucket_num; ++b)
+    {
+        stats_.onBucket();
+    }
+    return first;
+}
+
+// Takes an idle bucket or acquires a new one
+void* FixedMemPool::makeBucket()
+{
+    void* bucket;
+    if (!idle_bucket_list_.empty())
+    {
+        bucket = idle_bucket_list_.back();
+        idle_bucket_list_.pop_back();
+        if (provider_->isPrefault())
+        {
+            BucketProvider::touchPages(bucket, bucket_size_);
+        }
+    }
+    else
+    {
+        bucket = provider_->acquire(bucket_size_, bucket_alignment_);
+        if (page_map_)
+        {
+            page_map_->set(bucket, bucket_size_, page_value_);
+        }
+    }
+    if (lock_buckets_)
+    {
+        try
+        {
+            BucketProvider::lockPages(bucket, bucket_size_);
+        }
+        catch (...)
+        {
+            releaseBucket(bucket);
+            throw;
+        }
+    }
+    return bucket;
+}
+
+// Links the entries of the bucket in front of first and adds the bucket to
+// the pool. Never throws once bucket_list_ has room
+FixedMemPool::EntryHeader* FixedMemPool::linkBucket(void* bucket, EntryHeader* first)
+{
+    uint8_t* p = static_cast<uint8_t*>(bucket) + value_offset_ - header_size_;
     EntryHeader* entry=reinterpret_cast<EntryHeader*>(p);
-    for ( int i=0; i<entry_num_per_bucket_-1; ++i )
+    EntryHeader* bucket_first = entry;
+    for ( size_t i=0; i<entry_num_per_bucket_-1; ++i )
     {
         p+=entry_size_;
         entry->next_free_entry_ = reinterpret_cast<EntryHeader*>(p);
         entry=reinterpret_cast<EntryHeader*>(p);
     }
-    entry->next_free_entry_ = nullptr;
+    entry->next_free_entry_ = first;
     bucket_list_.push_back(bucket);
-    return reinterpret_cast<EntryHeader*>(bucket);
+    return bucket_first;
+}
+
+size_t FixedMemPool::trim(TrimStrategy strategy)
+{
+    size_t bucket_size = bucket_size_;
+    trim_trigger_ = trim_threshold_ == 0
+        ? SIZE_MAX
+        : std::max(trim_threshold_, free_num_ + entry_num_per_bucket_);
+    if (free_num_ < entry_num_per_bucket_)
+    {
+        return 0;
+    }
+
+    // Count the free entries of each bucket, a bucket with all of its
+    // entries in the free list has no allocated entry
+    std::sort(bucket_list_.begin(), bucket_list_.end());
+    auto bucketIndex = [this](EntryHeader* entry) -> size_t {
+        return std::upper_bound(bucket_list_.begin(), bucket_list_.end(),
+                                static_cast<void*>(entry))
+               - bucket_list_.begin() - 1;
+    };
+    std::vector<size_t> free_nums(bucket_list_.size(), 0);
+    size_t idle_num = 0;
+    for (EntryHeader* entry = head_; entry; entry = entry->next_free_entry_)
+    {
+        if (++free_nums[bucketIndex(entry)] == entry_num_per_bucket_)
+        {
+            ++idle_num;
+        }
+    }
+    if (idle_num == 0)
+    {
+        return 0;
+    }
+
+    // Unlink the entries of idle buckets, keeping the order of the others
+    EntryHeader** link = &head_;
+    for (EntryHeader* entry = head_; entry; entry = entry->next_free_entry_)
+    {
+        if (free_nums[bucketIndex(entry)] != entry_num_per_bucket_)
+        {
+            *link = entry;
+            link = &entry->next_free_entry_;
+        }
+    }
+    *link = nullptr;
+
+    size_t kept = 0;
+    for (size_t i=0; i<bucket_list_.size(); ++i)
+    {
+        void* bucket = bucket_list_[i];
+        if (free_nums[i] != entry_num_per_bucket_)
+        {
+            bucket_list_[kept++] = bucket;
+        }
+        else if (strategy == TS_DontNeed)
+        {
+            // madvise fails on locked pages, makeBucket locks it again
+            if (lock_buckets_)
+            {
+                BucketProvider::unlockPages(bucket, bucket_size);
+            }
+            provider_->discard(bucket, bucket_size);
+            idle_bucket_list_.push_back(bucket);
+        }
+        else
+        {
+            releaseBucket(bucket);
+        }
+    }
+    bucket_list_.resize(kept);
+    free_num_ -= idle_num*entry_num_per_bucket_;
+    if (trim_threshold_ != 0)
+    {
+        trim_trigger_ = std::max(trim_threshold_, free_num_ + entry_num_per_bucket_);
+    }
+    stats_.onTrim(idle_num);
+    return idle_num*bucket_size;
+}
+
+void FixedMemPool::setTrimThreshold(size_t free_entry_num, TrimStrategy strategy)
+{
+    trim_threshold_ = free_entry_num;
+    trim_strategy_ = strategy;
+    trim_trigger_ = free_entry_num == 0 ? SIZE_MAX : free_entry_num;
+}
+
+void FixedMemPool::reserve(size_t entry_num)
+{
+    if (free_num_ >= entry_num)
+    {
+        return;
+    }
+    size_t bucket_num = (entry_num-free_num_+entry_num_per_bucket_-1)/entry_num_per_bucket_;
+    EntryHeader* first = newBucket(bucket_num);
+    // The new entries go after the free ones, which may be warm in cache
+    EntryHeader** link = &head_;
+    while (*link)
+    {
+        link = &(*link)->next_free_entry_;
+    }
+    *link = first;
+    if (trim_threshold_ != 0)
+    {
+        trim_trigger_ = std::max(trim_trigger_, free_num_ + entry_num_per_bucket_);
+    }
+}
+
+void FixedMemPool::prefault(bool lock)
+{
+    for (void* bucket: bucket_list_)
+    {
+        if (lock && !lock_buckets_)
+        {
+            BucketProvider::lockPages(bucket, bucket_size_);
+        }
+        BucketProvider::touchPages(bucket, bucket_size_);
+    }
+    lock_buckets_ = lock_buckets_ || lock;
+}
+
+void FixedMemPool::sortFreeList()
+{
+    std::vector<EntryHeader*> entries;
+    entries.reserve(free_num_);
+    for (EntryHeader* entry = head_; entry; entry = entry->next_free_entry_)
+    {
+        entries.push_back(entry);
+    }
+    if (entries.empty())
+    {
+        return;
+    }
+    std::sort(entries.begin(), entries.end());
+    for (size_t i=0; i+1<entries.size(); ++i)
+    {
+        entries[i]->next_free_entry_ = entries[i+1];
+    }
+    entries.back()->next_free_entry_ = nullptr;
+    head_ = entries.front();
 }
 
+PoolStats FixedMemPool::getStats() const
+{
+    PoolStats stats;
+    stats_.snapshot(stats);
+    stats.value_size_ = value_size_;
+    stats.entry_size_ = entry_size_;
+    stats.mapped_bytes_ = stats.buckets_*bucket_size_;
+    return stats;
+}
+
+
+//-----------------------------------------------------------------------------
+// class OwnedFixedMemPool
+//-----------------------------------------------------------------------------
+namespace
+{
+std::atomic<OwnedFixedMemPool*> s_owned_pools[OwnedFixedMemPool::MAX_POOL_NUMBER];
+
+// The address of a thread local variable identifies the calling thread
+// without the cost of std::this_thread::get_id()
+thread_local char s_thread_token;
+}
+
+OwnedFixedMemPool::OwnedFixedMemPool(
+    size_t value_size,
+    size_t entry_num_per_bucket,
+    bool lazy_alloc,
+    BucketProvider* provider
+)
+    : FixedMemPool(value_size, entry_num_per_bucket, lazy_alloc, provider)
+    , owner_(&s_thread_token)
+{
+    for (size_t id=0; id<MAX_POOL_NUMBER; ++id)
+    {
+        OwnedFixedMemPool* vacant = nullptr;
+        if (s_owned_pools[id].compare_exchange_strong(
+                vacant, this, std::memory_order_acq_rel))
+        {
+            id_ = uint16_t(id);
+            return;
+        }
+    }
+    throw std::runtime_error(std::string("OwnedFixedMemPool: too many pools"));
+}
+
+OwnedFixedMemPool::~OwnedFixedMemPool()
+{
+    s_owned_pools[id_].store(nullptr, std::memory_order_release);
+}
+
+void OwnedFixedMemPool::bindOwner()
+{
+    owner_ = &s_thread_token;
+}
+
+void* OwnedFixedMemPool::alloc()
+{
+    if (!head_)
+    {
+        drainRemote();
+    }
+    return FixedMemPool::alloc(id_);
+}
+
+void OwnedFixedMemPool::allocN(void** out, size_t n)
+{
+    if (!head_)
+    {
+        drainRemote();
+    }
+    FixedMemPool::allocN(out, n, id_);
+}
+
+void OwnedFixedMemPool::freeN(void** in, size_t n)
+{
+    if (TF_LIKELY(owner_ == &s_thread_token))
+    {
+        FixedMemPool::freeN(in, n);
+        return;
+    }
+    for (size_t i=0; i<n; ++i) free(in[i]);
+}
+
+void OwnedFixedMemPool::free(void* p)
+{
+    if (TF_LIKELY(owner_ == &s_thread_token))
+    {
+        FixedMemPool::free(p);
+        return;
+    }
+
+    EntryHeader* cur_head = reinterpret_cast<EntryHeader*>(p) - 1;
+    if (EntryHeader::MAGIC_WORD != cur_head->header_struct_.magic_word_)
+    {
+        throw std::runtime_error(std::string("OwnedFixedMemPool::free: memory currupted"));
+    }
+    EntryHeader* remote_head = remote_head_.load(std::memory_order_relaxed);
+    do
+    {
+        cur_head->next_free_entry_ = remote_head;
+    }
+    while (!remote_head_.compare_exchange_weak(
+                remote_head, cur_head,
+                std::memory_order_release, std::memory_order_relaxed));
+}
+
+void OwnedFixedMemPool::release(void* p)
+{
+    uint16_t id = entryBin(p);
+    OwnedFixedMemPool* pool = id < MAX_POOL_NUMBER
+        ? s_owned_pools[id].load(std::memory_order_acquire) : nullptr;
+    if (!pool)
+    {
+        throw std::runtime_error(std::string("OwnedFixedMemPool::release: currupted memory"));
+    }
+    pool->free(p);
+}
+
+// Called by the owner when its free list is empty. The consumer side of
+// the return list takes the whole list at once, so there is no ABA issue.
+void OwnedFixedMemPool::drainRemote()
+{
+    EntryHeader* remote_head = remote_head_.exchange(nullptr, std::memory_order_acquire);
+    if (!remote_head)
+    {
+        return;
+    }
+    uint64_t num = 0;
+    for (EntryHeader* entry = remote_head; entry; entry = entry->next_free_entry_)
+    {
+        ++num;
+    }
+    head_ = remote_head;
+    free_num_ += num;
+    stats_.onFree(num);
+}
+
+//-----------------------------------------------------------------------------
+// class ConcurrentFixedMemPool
+//-----------------------------------------------------------------------------
+ConcurrentFixedMemPool::ConcurrentFixedMemPool(
+    size_t value_size,
+    size_t entry_num_per_bucket,
+    bool lazy_alloc,
+    BucketProvider* provider
+)
+    : value_size_(value_size)
+    , entry_size_ (sizeof(EntryHeader)+constAlign(value_size,8))
+    , entry_num_per_bucket_(entry_num_per_bucket)
+    , provider_(provider ? provider : BucketProvider::defaultProvider())
+{
+    if (!lazy_alloc)
+    {
+        EntryHeader* first = newBucket();
+        push(first, first);
+    }
+}
+
+ConcurrentFixedMemPool::~ConcurrentFixedMemPool()
+{
+    for (auto bucket: bucket_list_)
+    {
+        provider_->release(bucket, entry_size_*entry_num_per_bucket_);
+    }
+}
+
+ConcurrentFixedMemPool::EntryHeader* ConcurrentFixedMemPool::pop()
+{
+    uint64_t head = head_.load(std::memory_order_acquire);
+    EntryHeader* entry;
+    do
+    {
+        entry = headPtr(head);
+        if (!entry)
+        {
+            return nullptr;
+        }
+        // The entry may be popped and overwritten by another thread at this
+        // point. The read value is then garbage but the CAS fails because
+        // the tag has moved on.
+        EntryHeader* next =
+            __atomic_load_n(&entry->next_free_entry_, __ATOMIC_RELAXED);
+        if (head_.compare_exchange_weak(
+                head, nextHead(head, next),
+                std::memory_order_acq_rel, std::memory_order_acquire))
+        {
+            return entry;
+        }
+        pause();
+    }
+    while (true);
+}
+
+void ConcurrentFixedMemPool::push(EntryHeader* first, EntryHeader* last)
+{
+    uint64_t head = head_.load(std::memory_order_relaxed);
+    do
+    {
+        __atomic_store_n(&last->next_free_entry_, headPtr(head), __ATOMIC_RELAXED);
+    }
+    while (!head_.compare_exchange_weak(
+                head, nextHead(head, first),
+                std::memory_order_release, std::memory_order_relaxed));
+}
+
+void* ConcurrentFixedMemPool::alloc(uint16_t bin)
+{
+    EntryHeader* entry = pop();
+    if (!entry)
+    {
+        entry = newBucket();
+    }
+    entry->setAllocated(bin);
+    return entry+1;
+}
+
+void ConcurrentFixedMemPool::free(void* p)
+{
+    EntryHeader* cur_head = reinterpret_cast<EntryHeader*>(p) - 1;
+
+    if (EntryHeader::MAGIC_WORD != cur_head->header_struct_.magic_word_)
+    {
+        throw std::runtime_error(std::string("ConcurrentFixedMemPool::free: memory currupted"));
+    }
+
+    push(cur_head, cur_head);
+}
+
+// Returns an entry for the caller and pushes the rest of the new bucket to
+// the free list. Threads that race here serialize on bucket_mutex_, and a
+// late comer takes an entry freed by the winner instead of another bucket.
+ConcurrentFixedMemPool::EntryHeader* ConcurrentFixedMemPool::newBucket()
+{
+    ScopedSpinLock lock(bucket_mutex_);
+    if (EntryHeader* entry = pop())
+    {
+        return entry;
+    }
+
+    void* bucket = provider_->acquire(entry_size_*entry_num_per_bucket_);
+    bucket_list_.push_back(bucket);
+
+    uint8_t* p = reinterpret_cast<uint8_t*>(bucket);
+    EntryHeader* first = reinterpret_cast<EntryHeader*>(p);
+    if (entry_num_per_bucket_ > 1)
+    {
+        EntryHeader* entry = reinterpret_cast<EntryHeader*>(p+entry_size_);
+        EntryHeader* second = entry;
+        for (size_t i=2; i<entry_num_per_bucket_; ++i)
+        {
+            p += entry_size_;
+            entry->next_free_entry_ = reinterpret_cast<EntryHeader*>(p+entry_size_);
+            entry = entry->next_free_entry_;
+        }
+        push(second, entry);
+    }
+    return first;
+}
 
 //-----------------------------------------------------------------------------
 // class MemPool
@@ -116,7 +715,7 @@ MemPool::~MemPool( )
     for (size_t i=0; i<POOL_NUMBER; ++i) delete pools_[i];
 }
 
-inline void MemPool::free(size_t bin, void* p)
+void MemPool::free(size_t bin, void* p)
 {
     if (bin >= POOL_NUMBER || nullptr == pools_[bin])
     {
@@ -125,33 +724,152 @@ inline void MemPool::free(size_t bin, void* p)
     reinterpret_cast<FixedMemPool*>(pools_[bin])->free(p);
 }
 
-inline void* MemPool::alloc(size_t bin, size_t entry_size)
+FixedMemPool* MemPool::getPool(size_t bin)
 {
     if (nullptr == pools_[bin])
     {
-        size_t entry_num_per_bucket = (POOL_NUMBER-bin)*100;
-        pools_[bin] = new FixedMemPool(entry_size, entry_num_per_bucket);
+        pools_[bin] = new FixedMemPool(binSize(bin), binEntryNum(bin),
+                                       true, provider_, 8, HEADERLESS);
+        pools_[bin]->usePageMap(&page_map_, uint16_t(bin+1));
+    }
+    return pools_[bin];
+}
+
+void* MemPool::alloc(size_t bin, size_t entry_size)
+{
+    FixedMemPool* pool = getPool(bin);
+    pool->stats_.onRequest(entry_size);
+    return pool->alloc(bin);
+}
+
+void MemPool::allocN(size_t bin, void** out, size_t n, size_t entry_size)
+{
+    FixedMemPool* pool = getPool(bin);
+    pool->stats_.onRequest(entry_size*n);
+    pool->allocN(out, n, bin);
+}
+
+void MemPool::freeN(size_t bin, void** in, size_t n)
+{
+    if (bin >= POOL_NUMBER || nullptr == pools_[bin])
+    {
+        throw std::runtime_error(std::string("MemPool::freeN: currupted memory"));
     }
-    return pools_[bin]->alloc(bin);
+    pools_[bin]->freeN(in, n);
 }
 
 void* MemPool::alloc(size_t size)
 {
-    int bin = size <= 8 ? 0 : log2Floor(size-1) - 2;
-    if (bin >= POOL_NUMBER)
+    if (size > MAX_VALUE_SIZE)
     {
         throw std::runtime_error(std::string("MemPool::alloc: size too big"));;
     }
 
-    return alloc(bin, size);
+    return alloc(sizeToBin(size), size);
+}
+
+size_t MemPool::entryBin(const void* p) const
+{
+    uint16_t value = page_map_.get(p);
+    if (TF_UNLIKELY(value == 0))
+    {
+        throw std::runtime_error(std::string("MemPool::entryBin: not a MemPool entry"));
+    }
+    return value-1;
 }
 
 void MemPool::free(void* p)
 {
-    FixedMemPool::EntryHeader* cur_head =
-        reinterpret_cast<FixedMemPool::EntryHeader*>(p) - 1;
-    uint16_t bin =  cur_head->header_struct_.bin_;
-    free(bin, p);
+    free(entryBin(p), p);
+}
+
+size_t MemPool::trim(TrimStrategy strategy)
+{
+    size_t trimmed = 0;
+    for (size_t bin=0; bin<POOL_NUMBER; ++bin)
+    {
+        if (pools_[bin])
+        {
+            trimmed += pools_[bin]->trim(strategy);
+        }
+    }
+    return trimmed;
+}
+
+void MemPool::reserve(size_t entry_size, size_t entry_num)
+{
+    if (entry_size > MAX_VALUE_SIZE)
+    {
+        throw std::runtime_error(std::string("MemPool::reserve: size too big"));
+    }
+    getPool(sizeToBin(entry_size))->reserve(entry_num);
+}
+
+void MemPool::prefault(bool lock)
+{
+    for (size_t bin=0; bin<POOL_NUMBER; ++bin)
+    {
+        if (pools_[bin])
+        {
+            pools_[bin]->prefault(lock);
+        }
+    }
+}
+
+void MemPool::sortFreeList()
+{
+    for (size_t bin=0; bin<POOL_NUMBER; ++bin)
+    {
+        if (pools_[bin])
+        {
+            pools_[bin]->sortFreeList();
+        }
+    }
+}
+
+void MemPool::getStats(std::vector<PoolStats>& stats) const
+{
+    for (size_t bin=0; bin<POOL_NUMBER; ++bin)
+    {
+        if (nullptr == pools_[bin])
+        {
+            continue;
+        }
+        PoolStats bin_stats = pools_[bin]->getStats();
+        bin_stats.bin_ = bin;
+        if (bin_stats.requested_bytes_ > 0)
+        {
+            bin_stats.padding_bytes_ =
+                bin_stats.allocs_*bin_stats.value_size_ - bin_stats.requested_bytes_;
+        }
+        stats.push_back(bin_stats);
+    }
+}
+
+void MemPool::dumpStats(std::ostream& os) const
+{
+    std::vector<PoolStats> stats;
+    getStats(stats);
+    os << std::setw(4) << "bin" << std::setw(7) << "size"
+       << std::setw(12) << "allocs" << std::setw(12) << "frees"
+       << std::setw(10) << "live" << std::setw(10) << "peak"
+       << std::setw(8) << "buckets" << std::setw(12) << "mapped"
+       << std::setw(8) << "frag%" << '\n';
+    for (const PoolStats& bin_stats: stats)
+    {
+        double frag = bin_stats.requested_bytes_ == 0 ? 0.0 :
+            100.0*bin_stats.padding_bytes_/(bin_stats.allocs_*bin_stats.value_size_);
+        os << std::setw(4) << bin_stats.bin_
+           << std::setw(7) << bin_stats.value_size_
+           << std::setw(12) << bin_stats.allocs_
+           << std::setw(12) << bin_stats.frees_
+           << std::setw(10) << bin_stats.live_
+           << std::setw(10) << bin_stats.high_water_
+           << std::setw(8) << bin_stats.buckets_
+           << std::setw(12) << bin_stats.mapped_bytes_
+           << std::setw(8) << std::fixed << std::setprecision(1) << frag
+           << '\n';
+    }
 }
 
 } // name space tf
@@ -2,7 +2,13 @@
 
 #include "Platform.h"
 #include "Intrinsics.h"
+#include "Concurrency.h"
+#include "BucketProvider.h"
+#include "MemPoolStats.h"
+#include "PageMap.h"
 
+#include <atomic>
+#include <iosfwd>
 #include <vector>
 
 namespace tf
@@ -10,13 +16,32 @@ namespace tf
 
 class MemPool;
 
+/// How FixedMemPool::trim gives fully free buckets back to the OS
+enum TrimStrategy: uint8_t
+{
+    TS_Unmap,       // Release the bucket to its provider (free or munmap)
+    TS_DontNeed     // Keep the bucket mapped for reuse, drop its pages
+};
+
 class FixedMemPool
 {
   public:
       
+    /// Buckets are allocated from the given provider, or from malloc when
+    /// no provider is given.
+    /// Values are aligned to alignment, a power of two of at least 8. An
+    /// entry normally carries an 8 byte header right before the value. With
+    /// headerless set, release builds drop the header and the free list link
+    /// overlays the value, so a 64 byte value aligned to 64 takes exactly
+    /// one cache line. Headerless entries have no bin, no reference count
+    /// and no corruption check on free. Debug builds (no NDEBUG) always
+    /// keep the header to catch bad frees
     FixedMemPool(size_t value_size,
             size_t entry_num_per_bucket=100,
-            bool lazy_alloc = true);
+            bool lazy_alloc = true,
+            BucketProvider* provider = nullptr,
+            size_t alignment = 8,
+            bool headerless = false);
 
     ~FixedMemPool();
 
@@ -24,25 +49,118 @@ class FixedMemPool
 
     void free(void* p) noexcept(false);
 
-  private:
+    /// Allocates n entries into out. The entries are taken from the free
+    /// list in one pass, and when it runs short all the buckets needed for
+    /// the rest are made at once
+    void allocN(void** out, size_t n, uint16_t bin = 0) noexcept(false);
+
+    /// Frees n entries, splicing them to the free list as one segment
+    void freeN(void** in, size_t n) noexcept(false);
+
+    /// Returns the bin stamped in the header of an allocated entry. Throws
+    /// if the entry header is corrupted
+    static uint16_t entryBin(const void* p) noexcept(false);
+
+    /// Returns the reference count of an allocated entry, the 32 bits of
+    /// the entry header right before the value. alloc sets it to 1. The
+    /// pools never read it, it is there for PoolPtr
+    TF_INLINE static uint32_t* refCount(void* p)
+    { return reinterpret_cast<uint32_t*>(p) - 1; }
+
+    /// Returns true when the entries have no header, see the constructor
+    bool isHeaderless() const { return header_size_ == 0; }
+
+    /// Returns a snapshot of the pool statistics, see PoolStats
+    PoolStats getStats() const;
+
+    /// Gives the buckets with no allocated entry back to the OS and returns
+    /// the number of bytes given back. Each free entry is looked up in the
+    /// sorted bucket list, so the cost is free entries times log buckets.
+    /// With TS_DontNeed, buckets locked by prefault are unlocked first, as
+    /// the pages of locked memory cannot be dropped, and are locked again
+    /// when reused
+    size_t trim(TrimStrategy strategy = TS_Unmap);
+
+    /// Trims automatically once more than free_entry_num entries are free.
+    /// A trim that cannot release a bucket is not retried before another
+    /// bucket worth of entries is freed. Zero disables automatic trim
+    void setTrimThreshold(size_t free_entry_num,
+                          TrimStrategy strategy = TS_Unmap);
+
+    /// Makes the buckets needed to have at least entry_num free entries,
+    /// so that that many allocations never make a bucket. Automatic trim
+    /// does not give the reserved buckets back before they are used
+    void reserve(size_t entry_num) noexcept(false);
+
+    /// Touches every page of the buckets so that allocations take no page
+    /// fault. With lock set, the buckets and the ones made later are also
+    /// locked in memory. Meant to be called at startup, after reserve
+    void prefault(bool lock = false) noexcept(false);
+
+    /// Relinks the free list in address order, so that consecutive
+    /// allocations walk memory sequentially. The cost is n log n in the
+    /// number of free entries
+    void sortFreeList();
+
+  protected:
     friend class MemPool;
+    friend class ConcurrentFixedMemPool;
 
     struct EntryHeader;
-    EntryHeader* newBucket()  noexcept(false);
-    EntryHeader*              head_;
+    EntryHeader* newBucket(size_t bucket_num = 1)  noexcept(false);
+    void* makeBucket() noexcept(false);
+    EntryHeader* linkBucket(void* bucket, EntryHeader* first);
+    void releaseBucket(void* bucket);
+
+    /// Aligns buckets to slabs and maps their slabs to value in page_map.
+    /// Must be called before the first bucket is made
+    void usePageMap(PageMap* page_map, uint16_t value) noexcept(false);
+    void setBucketAlignment(size_t bucket_alignment);
+
+
+    EntryHeader*              head_ {nullptr};
     size_t                    value_size_;
+    size_t                    alignment_;
+    size_t                    header_size_;     // 0 when headerless
     size_t                    entry_size_;
+    size_t                    value_offset_;    // of the first value in a bucket
     size_t                    entry_num_per_bucket_;
+    size_t                    bucket_alignment_;
+    size_t                    bucket_size_;
+    BucketProvider*           provider_;
+    PageMap*                  page_map_ {nullptr};
+    uint16_t                  page_value_ {0};
     std::vector<void*>        bucket_list_;
+    std::vector<void*>        idle_bucket_list_;    // discarded by trim
+    size_t                    free_num_ {0};
+    size_t                    trim_threshold_ {0};
+    size_t                    trim_trigger_ {SIZE_MAX};
+    TrimStrategy              trim_strategy_ {TS_Unmap};
+    bool                      lock_buckets_ {false};
+    PoolCounters              stats_;
 };
 
 //-----------------------------------------------------------------------------
-template <typename  T>
+/**
+ * \class FixedPool
+ * \ingroup MemPool
+ * \brief A FixedMemPool of objects of type T.
+ * Objects are aligned to ALIGN, alignof(T) by default. See FixedMemPool
+ * for HEADERLESS.
+ */
+template <typename  T,
+          size_t ALIGN = (alignof(T) > 8 ? alignof(T) : 8),
+          bool HEADERLESS = false>
 class FixedPool: public FixedMemPool
 {
+    static_assert(ALIGN >= alignof(T) && (ALIGN & (ALIGN-1)) == 0,
+                  "ALIGN must be a power of two not less than alignof(T)");
   public:
-    FixedPool(size_t entry_num_per_bucket, bool lazy_alloc = true)
-        : FixedMemPool(sizeof(T), entry_num_per_bucket, lazy_alloc) {}
+    FixedPool(size_t entry_num_per_bucket,
+              bool lazy_alloc = true,
+              BucketProvider* provider = nullptr)
+        : FixedMemPool(sizeof(T), entry_num_per_bucket, lazy_alloc, provider,
+                       ALIGN, HEADERLESS) {}
 
     T* alloc() noexcept(false)
     {
@@ -55,9 +173,193 @@ class FixedPool: public FixedMemPool
         v->~T();
         FixedMemPool::free(v);
     }
+
+    void allocN(T** out, size_t n) noexcept(false)
+    {
+        FixedMemPool::allocN(reinterpret_cast<void**>(out), n);
+        for (size_t i=0; i<n; ++i) new (out[i]) T;
+    }
+
+    void freeN(T** in, size_t n) noexcept(false)
+    {
+        for (size_t i=0; i<n; ++i) in[i]->~T();
+        FixedMemPool::freeN(reinterpret_cast<void**>(in), n);
+    }
+};
+
+//-----------------------------------------------------------------------------
+/**
+ * \class OwnedFixedMemPool
+ * \ingroup MemPool
+ * \brief A FixedMemPool owned by one thread that can be freed to by others.
+ * The owner thread allocates and frees on the plain free list, with no
+ * atomic operation. A free from any other thread pushes the entry to a
+ * lock-free multi-producer return list. The owner takes the whole return
+ * list back with one exchange when its free list runs empty.
+ * Each pool gets a registry id that is stamped in the bin field of its
+ * entry headers, so release() can return an entry to its owning pool from
+ * the entry pointer alone.
+ */
+class OwnedFixedMemPool: public FixedMemPool
+{
+  public:
+    constexpr static size_t MAX_POOL_NUMBER = 4096;
+
+    /// The pool is owned by the constructing thread
+    OwnedFixedMemPool(size_t value_size,
+            size_t entry_num_per_bucket=100,
+            bool lazy_alloc = true,
+            BucketProvider* provider = nullptr);
+
+    ~OwnedFixedMemPool();
+
+    /// Makes the calling thread the owner, e.g. when the pool is created
+    /// by a thread other than the one using it
+    void bindOwner();
+
+    /// Must be called by the owner thread
+    void* alloc() noexcept(false);
+
+    /// Can be called by any thread
+    void free(void* p) noexcept(false);
+
+    /// Batch versions of alloc and free, with the same thread rules
+    void allocN(void** out, size_t n) noexcept(false);
+    void freeN(void** in, size_t n) noexcept(false);
+
+    /// Returns an entry allocated from any OwnedFixedMemPool to its pool
+    static void release(void* p) noexcept(false);
+
+    uint16_t id() const { return id_; }
+
+  private:
+    void drainRemote();
+
+    uint16_t                        id_;
+    const void*                     owner_;
+    alignas(CPUInfo::cache_alignment_)
+    std::atomic<EntryHeader*>       remote_head_ {nullptr};
+};
+
+//-----------------------------------------------------------------------------
+template <typename  T>
+class OwnedFixedPool: public OwnedFixedMemPool
+{
+  public:
+    OwnedFixedPool(size_t entry_num_per_bucket,
+                   bool lazy_alloc = true,
+                   BucketProvider* provider = nullptr)
+        : OwnedFixedMemPool(sizeof(T), entry_num_per_bucket, lazy_alloc, provider) {}
+
+    T* alloc() noexcept(false)
+    {
+        void* p = OwnedFixedMemPool::alloc();
+        return new (p) T;
+    }
+
+    void free(T* v) noexcept(false)
+    {
+        v->~T();
+        OwnedFixedMemPool::free(v);
+    }
+
+    static void release(T* v) noexcept(false)
+    {
+        v->~T();
+        OwnedFixedMemPool::release(v);
+    }
+};
+
+//-----------------------------------------------------------------------------
+/**
+ * \class ConcurrentFixedMemPool
+ * \ingroup MemPool
+ * \brief A FixedMemPool that can be shared by multiple threads without lock.
+ * The free list is a Treiber stack. To avoid the ABA problem, the head
+ * carries a version tag that is bumped on every update: the entry pointer
+ * takes the low 48 bits (user space address on x86-64 and AArch64) and
+ * the tag takes the high 16 bits so that the head fits in one 64 bit CAS.
+ * Buckets are never released before the pool is destroyed, so a stale
+ * head read by a racing pop always points to mapped memory.
+ */
+class ConcurrentFixedMemPool
+{
+  public:
+    ConcurrentFixedMemPool(size_t value_size,
+            size_t entry_num_per_bucket=100,
+            bool lazy_alloc = true,
+            BucketProvider* provider = nullptr);
+
+    ~ConcurrentFixedMemPool();
+
+    void* alloc(uint16_t bin = 0) noexcept(false);
+
+    void free(void* p) noexcept(false);
+
+  private:
+    using EntryHeader = FixedMemPool::EntryHeader;
+
+    constexpr static int      TAG_SHIFT = 48;
+    constexpr static uint64_t PTR_MASK = (uint64_t(1) << TAG_SHIFT) - 1;
+
+    TF_INLINE static EntryHeader* headPtr(uint64_t head)
+    { return reinterpret_cast<EntryHeader*>(head & PTR_MASK); }
+
+    TF_INLINE static uint64_t nextHead(uint64_t head, EntryHeader* entry)
+    {
+        return ((head & ~PTR_MASK) + (uint64_t(1) << TAG_SHIFT)) |
+               reinterpret_cast<uint64_t>(entry);
+    }
+
+    EntryHeader* pop();
+    void push(EntryHeader* first, EntryHeader* last);
+    EntryHeader* newBucket()  noexcept(false);
+
+    alignas(CPUInfo::cache_alignment_)
+    std::atomic<uint64_t>     head_ {0};
+    alignas(CPUInfo::cache_alignment_)
+    size_t                    value_size_;
+    size_t                    entry_size_;
+    size_t                    entry_num_per_bucket_;
+    BucketProvider*           provider_;
+    SpinMutex                 bucket_mutex_;
+    std::vector<void*>        bucket_list_;
 };
 
 //-----------------------------------------------------------------------------
+template <typename  T>
+class ConcurrentFixedPool: public ConcurrentFixedMemPool
+{
+  public:
+    ConcurrentFixedPool(size_t entry_num_per_bucket,
+                        bool lazy_alloc = true,
+                        BucketProvider* provider = nullptr)
+        : ConcurrentFixedMemPool(sizeof(T), entry_num_per_bucket,
+                                 lazy_alloc, provider) {}
+
+    T* alloc() noexcept(false)
+    {
+        void* p = ConcurrentFixedMemPool::alloc();
+        return new (p) T;
+    }
+
+    void free(T* v) noexcept(false)
+    {
+        v->~T();
+        ConcurrentFixedMemPool::free(v);
+    }
+};
+
+//-----------------------------------------------------------------------------
+/**
+ * \class MemPool
+ * \ingroup MemPool
+ * \brief Size class pools for objects of up to MAX_VALUE_SIZE bytes.
+ * Bin buckets are aligned to PageMap slabs and registered in a page map, so
+ * free(void*) finds the bin of an entry from its address alone. When built
+ * with TF_MEMPOOL_HEADERLESS, release builds also drop the entry header,
+ * and entries cannot be used with PoolPtr or FixedMemPool::entryBin.
+ */
 class MemPool
 {
   public:
@@ -65,15 +367,61 @@ class MemPool
     static MemPool& instance();
 
     constexpr static size_t MAX_VALUE_SIZE = 8192;
-    constexpr static size_t POOL_NUMBER = constLog2(MAX_VALUE_SIZE)-2;
+#ifdef TF_MEMPOOL_HEADERLESS
+    constexpr static bool HEADERLESS = true;
+#else
+    constexpr static bool HEADERLESS = false;
+#endif
+
+    /// Size classes: 8, 16, 24 and 32 bytes, then each power of two range
+    /// (2^k, 2^(k+1)] is split in CLASS_STEPS classes of equal step, i.e.
+    /// 40, 48, 56, 64, 80, 96, 112, 128, 160, ... 8192. This bounds the
+    /// padding to 25% of an entry instead of 50% with power of two bins.
+    constexpr static size_t CLASS_STEPS = 4;
+    constexpr static size_t SMALL_CLASS_MAX = 32;
+    constexpr static size_t SMALL_CLASS_NUMBER = SMALL_CLASS_MAX/8;
+    constexpr static size_t POOL_NUMBER = SMALL_CLASS_NUMBER +
+        (constLog2(MAX_VALUE_SIZE)-constLog2(SMALL_CLASS_MAX))*CLASS_STEPS;
+
+    /// Returns the bin index for an entry of the given size
+    constexpr static uint32_t binIndex(size_t sz)
+    {
+        return sz <= SMALL_CLASS_MAX
+            ? (sz <= 8 ? 0 : (sz-1) >> 3)
+            : SMALL_CLASS_NUMBER +
+              (constLog2(sz-1)-constLog2(SMALL_CLASS_MAX))*CLASS_STEPS +
+              ((sz-1-(size_t(1) << constLog2(sz-1))) >>
+                (constLog2(sz-1)-constLog2(CLASS_STEPS)));
+    }
+
+    /// Returns the value size of entries in the given bin
+    constexpr static size_t binSize(size_t bin)
+    {
+        return bin < SMALL_CLASS_NUMBER
+            ? (bin+1)*8
+            : (SMALL_CLASS_MAX << (bin-SMALL_CLASS_NUMBER)/CLASS_STEPS) +
+              ((bin-SMALL_CLASS_NUMBER)%CLASS_STEPS+1) *
+              ((SMALL_CLASS_MAX/CLASS_STEPS) << (bin-SMALL_CLASS_NUMBER)/CLASS_STEPS);
+    }
+
+    /// Returns the number of entries per bucket in the given bin, sized
+    /// to make buckets of about BUCKET_SIZE bytes
+    constexpr static size_t BUCKET_SIZE = 64*1024;
+    constexpr static size_t binEntryNum(size_t bin)
+    { return BUCKET_SIZE/binSize(bin) > 100 ? BUCKET_SIZE/binSize(bin) : 100; }
+
+    /// Returns the bin index for a size not known at compile time. The
+    /// size must not be greater than MAX_VALUE_SIZE
+    TF_INLINE static uint32_t sizeToBin(size_t sz)
+    { return s_bin_table_.bins_[(sz+7) >> 3]; }
 
     template <typename T, typename... Args>
     T* acq(Args... args) noexcept(false)
     {
         constexpr size_t sz_aligned = constAlign(sizeof(T),8);
         static_assert (sz_aligned <= MAX_VALUE_SIZE);
-        constexpr uint32_t pool_index = sz_aligned <= 8 ? 0 : constLog2(sz_aligned-1) - 2;
-        void *p = alloc(pool_index, sz_aligned);
+        constexpr uint32_t pool_index = binIndex(sz_aligned);
+        void *p = alloc(pool_index, sizeof(T));
         return p ? new(p)T(args...) : (T*)nullptr;
     }
 
@@ -83,25 +431,92 @@ class MemPool
         if (p)
         {
             constexpr size_t sz_aligned = constAlign(sizeof(T),8);
-            constexpr uint32_t pool_index = sz_aligned <= 8 ? 0 : constLog2(sz_aligned-1) - 2;
+            constexpr uint32_t pool_index = binIndex(sz_aligned);
             p->~T();
             free(pool_index, (void*)p);
         }
     }
 
+    /// Constructs n objects at once, taking their entries from the bin in
+    /// one batch
+    template <typename T, typename... Args>
+    void acqN(T** out, size_t n, Args... args) noexcept(false)
+    {
+        constexpr size_t sz_aligned = constAlign(sizeof(T),8);
+        static_assert (sz_aligned <= MAX_VALUE_SIZE);
+        constexpr uint32_t pool_index = binIndex(sz_aligned);
+        allocN(pool_index, reinterpret_cast<void**>(out), n, sizeof(T));
+        for (size_t i=0; i<n; ++i) new(out[i])T(args...);
+    }
+
+    template <typename T>
+    void delN(T** in, size_t n) noexcept(false)
+    {
+        constexpr size_t sz_aligned = constAlign(sizeof(T),8);
+        constexpr uint32_t pool_index = binIndex(sz_aligned);
+        for (size_t i=0; i<n; ++i) in[i]->~T();
+        freeN(pool_index, reinterpret_cast<void**>(in), n);
+    }
+
     void free(void* p) noexcept(false);
     void* alloc(size_t entry_size) noexcept(false);
 
+    /// Returns the bin of an entry allocated from MemPool. Throws if the
+    /// entry is not from MemPool
+    size_t entryBin(const void* p) const noexcept(false);
+
+    /// Sets the provider for the buckets of bins created after this call
+    void setBucketProvider(BucketProvider* provider) { provider_ = provider; }
+
+    /// Appends a snapshot of each bin in use to stats. Allocation counters
+    /// are collected only when built with TF_MEMPOOL_STATS
+    void getStats(std::vector<PoolStats>& stats) const;
+
+    /// Prints the bin statistics as a table
+    void dumpStats(std::ostream& os) const;
+
+    /// Trims all bins, see FixedMemPool::trim
+    size_t trim(TrimStrategy strategy = TS_Unmap);
+
+    /// Reserves entry_num free entries in the bin of entry_size, see
+    /// FixedMemPool::reserve
+    void reserve(size_t entry_size, size_t entry_num) noexcept(false);
+
+    /// Prefaults the buckets of all bins in use, see FixedMemPool::prefault
+    void prefault(bool lock = false) noexcept(false);
+
+    /// Sorts the free lists of all bins, see FixedMemPool::sortFreeList
+    void sortFreeList();
+
   private:
 
     ~MemPool();
 
+    // Lookup table from size in 8 byte units to bin index, built at
+    // compile time
+    struct BinTable
+    {
+        uint8_t bins_[MAX_VALUE_SIZE/8+1];
+        constexpr BinTable(): bins_{0}
+        {
+            for (size_t i=1; i<=MAX_VALUE_SIZE/8; ++i) bins_[i] = binIndex(i*8);
+        }
+    };
+    static const BinTable s_bin_table_;
+
     void free(size_t bin, void* p) noexcept(false);
     void* alloc(size_t bin, size_t entry_size) noexcept(false);
+    void allocN(size_t bin, void** out, size_t n, size_t entry_size) noexcept(false);
+    void freeN(size_t bin, void** in, size_t n) noexcept(false);
+    FixedMemPool* getPool(size_t bin) noexcept(false);
 
     FixedMemPool* pools_ [POOL_NUMBER] {nullptr};
+    BucketProvider* provider_ {nullptr};
+    PageMap page_map_;
 };
 
+inline constexpr MemPool::BinTable MemPool::s_bin_table_ {};
+
 } // name space tf
 
 
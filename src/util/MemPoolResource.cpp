@@ -0,0 +1,45 @@
+#include "MemPoolResource.h"
+
+namespace tf
+{
+//-----------------------------------------------------------------------------
+// class MemPoolResource
+//-----------------------------------------------------------------------------
+MemPoolResource* MemPoolResource::defaultResource()
+{
+    // Never destroyed, like MemPool, so that static containers can still
+    // release their nodes during static destruction
+    static MemPoolResource* s_resource = new MemPoolResource;
+    return s_resource;
+}
+
+void* MemPoolResource::do_allocate(size_t bytes, size_t alignment)
+{
+    if (TF_LIKELY(bytes <= MemPool::MAX_VALUE_SIZE && alignment <= MAX_ALIGNMENT))
+    {
+        return MemPool::instance().alloc(bytes);
+    }
+    return upstream_->allocate(bytes, alignment);
+}
+
+void MemPoolResource::do_deallocate(void* p, size_t bytes, size_t alignment)
+{
+    if (TF_LIKELY(bytes <= MemPool::MAX_VALUE_SIZE && alignment <= MAX_ALIGNMENT))
+    {
+        MemPool::instance().free(p);
+    }
+    else
+    {
+        upstream_->deallocate(p, bytes, alignment);
+    }
+}
+
+bool MemPoolResource::do_is_equal(const std::pmr::memory_resource& other) const noexcept
+{
+    // All MemPoolResource instances share MemPool, but the upstream
+    // resources may differ
+    const MemPoolResource* rhs = dynamic_cast<const MemPoolResource*>(&other);
+    return rhs && rhs->upstream_->is_equal(*upstream_);
+}
+
+} // name space tf
@@ -0,0 +1,126 @@
+#pragma once
+
+#include "FixedMemPool.h"
+#include <memory_resource>
+#include <new>
+
+namespace tf
+{
+
+/**
+ * \class MemPoolResource
+ * \ingroup MemPool
+ * \brief A std::pmr::memory_resource serving allocations from MemPool bins.
+ * Allocations up to MemPool::MAX_VALUE_SIZE bytes with an alignment of at
+ * most 8 bytes go to the matching MemPool bin, anything else goes to the
+ * upstream resource. Like MemPool, it must be used by one thread at a time.
+ */
+class MemPoolResource: public std::pmr::memory_resource
+{
+  public:
+    constexpr static size_t MAX_ALIGNMENT = 8;
+
+    explicit MemPoolResource(
+        std::pmr::memory_resource* upstream = std::pmr::new_delete_resource()
+    ) : upstream_(upstream) {}
+
+    std::pmr::memory_resource* upstream() const { return upstream_; }
+
+    /// A resource shared by the containers that don't need their own
+    static MemPoolResource* defaultResource();
+
+  protected:
+    void* do_allocate(size_t bytes, size_t alignment) override;
+    void do_deallocate(void* p, size_t bytes, size_t alignment) override;
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override;
+
+    std::pmr::memory_resource*  upstream_;
+};
+
+//-----------------------------------------------------------------------------
+/**
+ * \class PoolAllocator
+ * \ingroup MemPool
+ * \brief A stateless STL allocator over MemPool::instance().
+ * Node based containers (std::map, std::set, std::list, ...) allocate one
+ * node at a time, which is served from the MemPool bin of the node size.
+ * Arrays above MemPool::MAX_VALUE_SIZE bytes and over aligned types fall
+ * back to the global operator new.
+ */
+template <typename T>
+class PoolAllocator
+{
+  public:
+    using value_type = T;
+
+    PoolAllocator() noexcept = default;
+    template <typename U>
+    PoolAllocator(const PoolAllocator<U>&) noexcept {}
+
+    T* allocate(size_t n) noexcept(false)
+    {
+        if (TF_LIKELY(isPooled(n)))
+        {
+            return static_cast<T*>(MemPool::instance().alloc(n*sizeof(T)));
+        }
+        return static_cast<T*>(::operator new(n*sizeof(T)));
+    }
+
+    void deallocate(T* p, size_t n) noexcept(false)
+    {
+        if (TF_LIKELY(isPooled(n)))
+        {
+            MemPool::instance().free(p);
+        }
+        else
+        {
+            ::operator delete(p);
+        }
+    }
+
+    template <typename U>
+    bool operator==(const PoolAllocator<U>&) const noexcept { return true; }
+    template <typename U>
+    bool operator!=(const PoolAllocator<U>&) const noexcept { return false; }
+
+  private:
+    TF_INLINE static bool isPooled(size_t n)
+    {
+        return alignof(T) <= MemPoolResource::MAX_ALIGNMENT &&
+               n <= MemPool::MAX_VALUE_SIZE/sizeof(T);
+    }
+};
+
+//-----------------------------------------------------------------------------
+/**
+ * \class MemPoolNew
+ * \ingroup MemPool
+ * \brief Routes new and delete of the deriving class to MemPool.
+ * Objects of up to MemPool::MAX_VALUE_SIZE bytes with an alignment of at
+ * most 8 bytes come from MemPool, others from the global operator new.
+ * MemPool is not thread safe, so the objects must be created and deleted
+ * on one thread.
+ */
+struct MemPoolNew
+{
+    static void* operator new(size_t size) noexcept(false)
+    {
+        return size <= MemPool::MAX_VALUE_SIZE
+            ? MemPool::instance().alloc(size)
+            : ::operator new(size);
+    }
+
+    static void operator delete(void* p, size_t size) noexcept
+    {
+        if (size <= MemPool::MAX_VALUE_SIZE)
+        {
+            MemPool::instance().free(p);
+        }
+        else
+        {
+            ::operator delete(p);
+        }
+    }
+};
+
+} // name space tf
@@ -0,0 +1,110 @@
+#pragma once
+
+#include "Platform.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+
+namespace tf
+{
+
+/**
+ * \struct PoolStats
+ * \ingroup MemPool
+ * \brief A snapshot of the statistics of one fixed size pool.
+ * Counters other than the sizes are only collected when the library is
+ * built with TF_MEMPOOL_STATS, otherwise they read zero.
+ */
+struct PoolStats
+{
+    size_t      bin_ {0};
+    size_t      value_size_ {0};      // usable size of an entry
+    size_t      entry_size_ {0};      // value size plus entry header
+    uint64_t    allocs_ {0};
+    uint64_t    frees_ {0};
+    uint64_t    live_ {0};
+    uint64_t    high_water_ {0};      // peak number of live entries
+    uint64_t    buckets_ {0};
+    uint64_t    mapped_bytes_ {0};    // memory held in buckets
+    uint64_t    requested_bytes_ {0}; // sum of sizes asked by allocations
+    uint64_t    padding_bytes_ {0};   // sum of bytes lost to bin rounding
+};
+
+#ifdef TF_MEMPOOL_STATS
+/**
+ * \class PoolCounters
+ * \brief Statistics counters of a pool.
+ * A FixedMemPool is used by one thread at a time, so the counters are
+ * updated with relaxed loads and stores rather than read-modify-write
+ * instructions. They are atomic only so that a monitoring thread can take
+ * a snapshot while the pool is in use.
+ */
+class PoolCounters
+{
+  public:
+    TF_INLINE void onAlloc(uint64_t num = 1)
+    {
+        add(allocs_, num);
+        uint64_t live = live_.load(std::memory_order_relaxed) + num;
+        live_.store(live, std::memory_order_relaxed);
+        if (live > high_water_.load(std::memory_order_relaxed))
+        {
+            high_water_.store(live, std::memory_order_relaxed);
+        }
+    }
+
+    TF_INLINE void onFree(uint64_t num = 1)
+    {
+        add(frees_, num);
+        live_.store(live_.load(std::memory_order_relaxed) - num,
+                    std::memory_order_relaxed);
+    }
+
+    TF_INLINE void onBucket() { add(buckets_); }
+
+    TF_INLINE void onTrim(uint64_t num)
+    {
+        buckets_.store(buckets_.load(std::memory_order_relaxed) - num,
+                       std::memory_order_relaxed);
+    }
+
+    TF_INLINE void onRequest(size_t size) { add(requested_bytes_, size); }
+
+    void snapshot(PoolStats& stats) const
+    {
+        stats.allocs_ = allocs_.load(std::memory_order_relaxed);
+        stats.frees_ = frees_.load(std::memory_order_relaxed);
+        stats.live_ = live_.load(std::memory_order_relaxed);
+        stats.high_water_ = high_water_.load(std::memory_order_relaxed);
+        stats.buckets_ = buckets_.load(std::memory_order_relaxed);
+        stats.requested_bytes_ = requested_bytes_.load(std::memory_order_relaxed);
+    }
+
+  private:
+    TF_INLINE static void add(std::atomic<uint64_t>& counter, uint64_t n = 1)
+    {
+        counter.store(counter.load(std::memory_order_relaxed) + n,
+                      std::memory_order_relaxed);
+    }
+
+    std::atomic<uint64_t>   allocs_ {0};
+    std::atomic<uint64_t>   frees_ {0};
+    std::atomic<uint64_t>   live_ {0};
+    std::atomic<uint64_t>   high_water_ {0};
+    std::atomic<uint64_t>   buckets_ {0};
+    std::atomic<uint64_t>   requested_bytes_ {0};
+};
+#else
+class PoolCounters
+{
+  public:
+    TF_INLINE void onAlloc(uint64_t = 1) {}
+    TF_INLINE void onFree(uint64_t = 1) {}
+    TF_INLINE void onBucket() {}
+    TF_INLINE void onTrim(uint64_t) {}
+    TF_INLINE void onRequest(size_t) {}
+    void snapshot(PoolStats&) const {}
+};
+#endif
+
+} // name space tf
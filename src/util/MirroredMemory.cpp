@@ -0,0 +1,160 @@
+#include "MirroredMemory.h"
+#include "Intrinsics.h"
+#include <stdexcept>      // for runtime_error
+
+#if (TF_OS_FAMILY==TF_OS_FAMILY_LINUX)
+    #include <fcntl.h>
+    #include <unistd.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+#endif
+
+namespace tf
+{
+//-----------------------------------------------------------------------------
+// class MirroredMemory
+//-----------------------------------------------------------------------------
+#if (TF_OS_FAMILY==TF_OS_FAMILY_LINUX)
+size_t MirroredMemory::pageSize()
+{
+    return size_t(::sysconf(_SC_PAGESIZE));
+}
+
+void MirroredMemory::map(size_t header_size, size_t size)
+{
+    int fd = ::memfd_create("tf_mirrored", MFD_CLOEXEC);
+    if (fd < 0)
+    {
+        throw std::runtime_error(std::string("MirroredMemory::map: memfd_create failed"));
+    }
+    try
+    {
+        mapFile(fd, header_size, size, true);
+    }
+    catch (...)
+    {
+        ::close(fd);
+        throw;
+    }
+    // The mappings keep the memory alive
+    ::close(fd);
+}
+
+void MirroredMemory::map(
+    const std::string& name,
+    size_t header_size,
+    size_t size,
+    bool create
+)
+{
+    std::string shm_name = "/" + name;
+    int flags = create ? O_RDWR | O_CREAT | O_EXCL : O_RDWR;
+    int fd = ::shm_open(shm_name.c_str(), flags, S_IRUSR | S_IWUSR);
+    if (fd < 0)
+    {
+        throw std::runtime_error("MirroredMemory::map: cannot open " + name);
+    }
+    try
+    {
+        mapFile(fd, header_size, size, create);
+    }
+    catch (...)
+    {
+        ::close(fd);
+        if (create)
+        {
+            ::shm_unlink(shm_name.c_str());
+        }
+        throw;
+    }
+    ::close(fd);
+    if (create)
+    {
+        name_ = shm_name;
+    }
+}
+
+void MirroredMemory::mapFile(int fd, size_t header_size, size_t size, bool resize)
+{
+    unmap();
+    size_t page_size = pageSize();
+    header_size = constAlign(header_size, page_size);
+    size = constAlign(size, page_size);
+    if (resize)
+    {
+        if (::ftruncate(fd, header_size+size) != 0)
+        {
+            throw std::runtime_error(std::string("MirroredMemory::map: cannot size memory"));
+        }
+    }
+    else
+    {
+        struct stat st;
+        if (::fstat(fd, &st) != 0 || size_t(st.st_size) != header_size+size)
+        {
+            throw std::runtime_error(std::string("MirroredMemory::map: size mismatch"));
+        }
+    }
+
+    // Reserve the whole range first, so that the two data mappings are
+    // guaranteed to be adjacent
+    size_t total_size = header_size + 2*size;
+    void* base = ::mmap(nullptr, total_size, PROT_NONE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED)
+    {
+        throw std::runtime_error(std::string("MirroredMemory::map: cannot reserve address range"));
+    }
+    char* addr = static_cast<char*>(base);
+    if (::mmap(addr, header_size+size, PROT_READ | PROT_WRITE,
+               MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED ||
+        ::mmap(addr+header_size+size, size, PROT_READ | PROT_WRITE,
+               MAP_SHARED | MAP_FIXED, fd, off_t(header_size)) == MAP_FAILED)
+    {
+        ::munmap(base, total_size);
+        throw std::runtime_error(std::string("MirroredMemory::map: cannot map memory"));
+    }
+    address_ = addr;
+    header_size_ = header_size;
+    size_ = size;
+}
+
+void MirroredMemory::unmap()
+{
+    if (address_)
+    {
+        ::munmap(address_, header_size_ + 2*size_);
+        address_ = nullptr;
+    }
+    if (!name_.empty())
+    {
+        ::shm_unlink(name_.c_str());
+        name_.clear();
+    }
+}
+#else
+size_t MirroredMemory::pageSize()
+{
+    return 4096;
+}
+
+void MirroredMemory::map(size_t, size_t)
+{
+    throw std::runtime_error(std::string("MirroredMemory::map: not supported"));
+}
+
+void MirroredMemory::map(const std::string&, size_t, size_t, bool)
+{
+    throw std::runtime_error(std::string("MirroredMemory::map: not supported"));
+}
+
+void MirroredMemory::mapFile(int, size_t, size_t, bool)
+{
+}
+
+void MirroredMemory::unmap()
+{
+}
+#endif
+
+} // name space tf
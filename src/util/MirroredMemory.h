@@ -0,0 +1,58 @@
+#pragma once
+
+#include "Platform.h"
+#include <stddef.h>
+#include <string>
+
+namespace tf
+{
+
+/**
+ * \class MirroredMemory
+ * \ingroup IPC
+ * \brief A memory region whose data is mapped twice, back to back.
+ * The region is a header followed by size bytes of data, and the same
+ * data pages are mapped again right after the first mapping. Any span of
+ * up to size bytes starting inside the data is then contiguous in virtual
+ * memory, even when it runs past the end of the data, which lets a ring
+ * hand out wrapped data without splitting it.
+ * The memory is either private to the process, backed by memfd_create, or
+ * a named POSIX shared memory object that other processes map the same
+ * way. Header and data sizes are rounded up to the page size.
+ */
+class MirroredMemory
+{
+  public:
+    MirroredMemory() = default;
+    ~MirroredMemory() { unmap(); }
+
+    MirroredMemory(const MirroredMemory&) = delete;
+    MirroredMemory& operator=(const MirroredMemory&) = delete;
+
+    /// Maps memory private to the process
+    void map(size_t header_size, size_t size) noexcept(false);
+
+    /// Maps the named shared memory, creating it when create is set. The
+    /// creator removes the name from the system on unmap
+    void map(const std::string& name, size_t header_size, size_t size,
+             bool create) noexcept(false);
+
+    void unmap();
+
+    char* header() const { return address_; }
+    char* data() const { return address_ ? address_ + header_size_ : nullptr; }
+    size_t size() const { return size_; }
+
+    static size_t pageSize();
+
+  private:
+    void mapFile(int fd, size_t header_size, size_t size,
+                 bool resize) noexcept(false);
+
+    char*           address_ {nullptr};
+    size_t          header_size_ {0};
+    size_t          size_ {0};
+    std::string     name_;              // set when created by name
+};
+
+} // name space tf
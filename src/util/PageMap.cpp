@@ -0,0 +1,52 @@
+#include "PageMap.h"
+#include <stdexcept>      // for runtime_error
+#include <string>         // for string used by runtime_error
+
+namespace tf
+{
+//-----------------------------------------------------------------------------
+// class PageMap
+//-----------------------------------------------------------------------------
+PageMap::~PageMap()
+{
+    for (auto& leaf: root_)
+    {
+        delete [] leaf.load(std::memory_order_relaxed);
+    }
+}
+
+void PageMap::set(const void* p, size_t size, uint16_t value)
+{
+    uintptr_t addr = reinterpret_cast<uintptr_t>(p);
+    if (addr & (SLAB_SIZE-1))
+    {
+        throw std::runtime_error(std::string("PageMap::set: address not slab aligned"));
+    }
+    uintptr_t first = addr >> SLAB_SHIFT;
+    uintptr_t last = (addr+size-1) >> SLAB_SHIFT;
+    if (size == 0 || last >> (ROOT_BITS+LEAF_BITS))
+    {
+        throw std::runtime_error(std::string("PageMap::set: address out of range"));
+    }
+    for (uintptr_t slab = first; slab <= last; ++slab)
+    {
+        std::atomic<uint16_t*>& root = root_[slab >> LEAF_BITS];
+        uint16_t* leaf = root.load(std::memory_order_acquire);
+        if (!leaf)
+        {
+            uint16_t* new_leaf = new uint16_t[size_t(1) << LEAF_BITS]();
+            if (root.compare_exchange_strong(leaf, new_leaf, std::memory_order_acq_rel))
+            {
+                leaf = new_leaf;
+            }
+            else
+            {
+                delete [] new_leaf;
+            }
+        }
+        __atomic_store_n(&leaf[slab & ((uintptr_t(1) << LEAF_BITS)-1)], value,
+                         __ATOMIC_RELAXED);
+    }
+}
+
+} // name space tf
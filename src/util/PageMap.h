@@ -0,0 +1,60 @@
+#pragma once
+
+#include "Platform.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+
+namespace tf
+{
+
+/**
+ * \class PageMap
+ * \ingroup MemPool
+ * \brief A radix map from addresses to 16 bit values, one per slab.
+ * The 48 bit user space address is split into a root index, a leaf index
+ * and the offset in a slab of SLAB_SIZE bytes. A lookup is two dependent
+ * loads. Leaves are allocated on first use and kept until the map is
+ * destroyed. Value 0 means the slab is not mapped.
+ * Values are written before the memory they describe is handed out, so
+ * lookups can run on any thread that got a pointer from that memory.
+ */
+class PageMap
+{
+  public:
+    constexpr static int    SLAB_SHIFT = 16;
+    constexpr static size_t SLAB_SIZE = size_t(1) << SLAB_SHIFT;
+    constexpr static int    ADDRESS_BITS = 48;
+    constexpr static int    LEAF_BITS = 16;
+    constexpr static int    ROOT_BITS = ADDRESS_BITS - SLAB_SHIFT - LEAF_BITS;
+
+    PageMap() = default;
+    ~PageMap();
+
+    PageMap(const PageMap&) = delete;
+    PageMap& operator=(const PageMap&) = delete;
+
+    TF_INLINE uint16_t get(const void* p) const
+    {
+        uintptr_t slab = reinterpret_cast<uintptr_t>(p) >> SLAB_SHIFT;
+        if (TF_UNLIKELY(slab >> (ROOT_BITS+LEAF_BITS)))
+        {
+            return 0;
+        }
+        const uint16_t* leaf =
+            root_[slab >> LEAF_BITS].load(std::memory_order_acquire);
+        return leaf ? leaf[slab & ((uintptr_t(1) << LEAF_BITS)-1)] : 0;
+    }
+
+    /// Maps every slab overlapping [p, p+size) to value. p must be slab
+    /// aligned
+    void set(const void* p, size_t size, uint16_t value) noexcept(false);
+
+    /// Unmaps every slab overlapping [p, p+size)
+    void clear(const void* p, size_t size) { set(p, size, 0); }
+
+  private:
+    std::atomic<uint16_t*>  root_[size_t(1) << ROOT_BITS] {};
+};
+
+} // name space tf
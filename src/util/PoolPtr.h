@@ -0,0 +1,168 @@
+#pragma once
+
+#include "FixedMemPool.h"
+#include <stdexcept>      // for runtime_error
+#include <string>         // for string used by runtime_error
+#include <type_traits>
+#include <utility>
+
+namespace tf
+{
+
+/**
+ * \class PoolPtr
+ * \ingroup MemPool
+ * \brief A reference counted handle to an object in a pool entry.
+ * The count lives in the entry header (FixedMemPool::refCount), so copying
+ * a handle allocates nothing and touches only the entry's own cache line.
+ * When the last handle goes away the object is destroyed and the entry is
+ * freed straight to its pool.
+ * Pool is the untyped pool the entry comes from: FixedMemPool, MemPool,
+ * OwnedFixedMemPool or ConcurrentFixedMemPool. The count is updated with
+ * atomic instructions when ATOMIC is set, which is the default for the
+ * pools that can be freed to from any thread. Handles sharing an entry in
+ * a FixedMemPool or MemPool must stay on one thread. Pools of headerless
+ * entries have no room for the count and are rejected.
+ */
+template <typename T, class Pool = MemPool,
+          bool ATOMIC = std::is_same<Pool, ConcurrentFixedMemPool>::value ||
+                        std::is_same<Pool, OwnedFixedMemPool>::value>
+class PoolPtr
+{
+  public:
+    PoolPtr() noexcept = default;
+
+    /// Constructs an object in a new entry of the pool. Throws if the
+    /// entries of the pool have no header
+    template <typename... Args>
+    static PoolPtr make(Pool* pool, Args&&... args) noexcept(false)
+    {
+        void* p;
+        if constexpr (std::is_same<Pool, MemPool>::value)
+        {
+            static_assert(sizeof(T) <= MemPool::MAX_VALUE_SIZE);
+            static_assert(!MemPool::HEADERLESS, "MemPool entries have no header");
+            p = pool->alloc(sizeof(T));
+        }
+        else
+        {
+            if constexpr (std::is_base_of<FixedMemPool, Pool>::value)
+            {
+                if (pool->isHeaderless())
+                {
+                    throw std::runtime_error(std::string("PoolPtr::make: pool entries have no header"));
+                }
+            }
+            p = pool->alloc();
+        }
+        *FixedMemPool::refCount(p) = 1;
+        try
+        {
+            return PoolPtr(pool, new(p)T(std::forward<Args>(args)...));
+        }
+        catch (...)
+        {
+            pool->free(p);
+            throw;
+        }
+    }
+
+    PoolPtr(const PoolPtr& other) noexcept
+      : pool_(other.pool_), ptr_(other.ptr_)
+    {
+        if (ptr_) addRef();
+    }
+
+    PoolPtr(PoolPtr&& other) noexcept
+      : pool_(other.pool_), ptr_(other.ptr_)
+    {
+        other.ptr_ = nullptr;
+    }
+
+    ~PoolPtr() noexcept { reset(); }
+
+    PoolPtr& operator=(PoolPtr other) noexcept
+    {
+        swap(other);
+        return *this;
+    }
+
+    /// Destroys the object and frees its entry when this is the last
+    /// handle. The pools only throw from free on a corrupted entry header,
+    /// which cannot be reported from a destructor, so it is ignored
+    void reset() noexcept
+    {
+        if (ptr_ && releaseRef())
+        {
+            ptr_->~T();
+            try
+            {
+                pool_->free(ptr_);
+            }
+            catch (...)
+            {
+            }
+        }
+        ptr_ = nullptr;
+    }
+
+    void swap(PoolPtr& other) noexcept
+    {
+        std::swap(pool_, other.pool_);
+        std::swap(ptr_, other.ptr_);
+    }
+
+    T* get() const { return ptr_; }
+    T& operator*() const { return *ptr_; }
+    T* operator->() const { return ptr_; }
+    explicit operator bool() const { return ptr_ != nullptr; }
+
+    uint32_t useCount() const
+    {
+        if (!ptr_) return 0;
+        uint32_t* count = FixedMemPool::refCount(ptr_);
+        return ATOMIC ? __atomic_load_n(count, __ATOMIC_RELAXED) : *count;
+    }
+
+    bool operator==(const PoolPtr& other) const { return ptr_ == other.ptr_; }
+    bool operator!=(const PoolPtr& other) const { return ptr_ != other.ptr_; }
+
+  private:
+    PoolPtr(Pool* pool, T* ptr): pool_(pool), ptr_(ptr) {}
+
+    TF_INLINE void addRef()
+    {
+        uint32_t* count = FixedMemPool::refCount(ptr_);
+        if (ATOMIC)
+        {
+            __atomic_fetch_add(count, 1, __ATOMIC_RELAXED);
+        }
+        else
+        {
+            ++*count;
+        }
+    }
+
+    /// Returns true when the last reference is dropped
+    TF_INLINE bool releaseRef()
+    {
+        uint32_t* count = FixedMemPool::refCount(ptr_);
+        if (ATOMIC)
+        {
+            return __atomic_sub_fetch(count, 1, __ATOMIC_ACQ_REL) == 0;
+        }
+        return --*count == 0;
+    }
+
+    Pool*   pool_ {nullptr};
+    T*      ptr_ {nullptr};
+};
+
+/// Constructs an object in a MemPool entry
+template <typename T, typename... Args>
+PoolPtr<T> makePoolPtr(Args&&... args) noexcept(false)
+{
+    return PoolPtr<T>::make(&MemPool::instance(), std::forward<Args>(args)...);
+}
+
+} // name space tf
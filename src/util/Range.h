@@ -18,12 +18,12 @@ namespace tf{
  * This is a base class of StrPool_T. When string is pooled, no release
  * from the pool.
  */
-template <typename T, class Allocator>
+template <typename T, class Allocator = std::allocator<std::pair<const T, T> > >
 class RangeSet
 {
   protected:
     // Using map's value type to represent a range
-    using RangeSetImpl = std::map<T, T, std::Greater, Allocate>;
+    using RangeSetImpl = std::map<T, T, std::greater<T>, Allocator>;
     using iterator = RangeSetImpl::iterator;
     using const_iterator = RangeSetImpl::const_iterator;
 
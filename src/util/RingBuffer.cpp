@@ -0,0 +1,141 @@
+#include "RingBuffer.h"
+#include <cstdlib>        // for aligned_alloc and free
+#include <new>            // for placement new and bad_alloc
+#include <stdexcept>      // for runtime_error
+#include <string>         // for string used by runtime_error
+#include <sys/uio.h>      // for readv and writev
+
+namespace tf
+{
+//-----------------------------------------------------------------------------
+// class RingBuffer
+//-----------------------------------------------------------------------------
+static_assert(std::atomic<uint64_t>::is_always_lock_free,
+              "RingBuffer needs address free 64 bit atomics");
+
+RingBuffer::RingBuffer(size_t capacity)
+    : capacity_(capacity <= 1 ? 1 : size_t(1) << (constLog2(capacity-1)+1))
+    , mask_(capacity_-1)
+{
+}
+
+RingBuffer::~RingBuffer()
+{
+    std::free(owned_);
+}
+
+size_t RingBuffer::requiredSize() const
+{
+    return constAlign(sizeof(RingHeader),CPUInfo::cache_alignment_) + capacity_;
+}
+
+void RingBuffer::init(char* addr, bool is_new)
+{
+    mirror_.unmap();
+    mirrored_ = false;
+    attach(addr, addr + constAlign(sizeof(RingHeader),CPUInfo::cache_alignment_), is_new);
+}
+
+void RingBuffer::attach(char* header, char* data, bool is_new)
+{
+    if (is_new)
+    {
+        header_ = new (header) RingHeader(capacity_);
+    }
+    else
+    {
+        header_ = reinterpret_cast<RingHeader*>(header);
+        if (header_->magic_word_ != RingHeader::MAGIC_WORD ||
+            header_->capacity_ != capacity_)
+        {
+            throw std::runtime_error(std::string("RingBuffer::init: ring mismatch"));
+        }
+    }
+    data_ = data;
+    max_record_size_ = mirrored_ ? capacity_ : capacity_/2;
+    write_pos_ = header_->write_pos_.load(std::memory_order_acquire);
+    read_pos_ = header_->read_pos_.load(std::memory_order_acquire);
+    read_pos_cache_ = read_pos_;
+    write_pos_cache_ = write_pos_;
+}
+
+void RingBuffer::init()
+{
+    char* addr = static_cast<char*>(std::aligned_alloc(
+        CPUInfo::cache_alignment_, constAlign(requiredSize(), CPUInfo::cache_alignment_)));
+    if (!addr)
+    {
+        throw std::bad_alloc();
+    }
+    std::free(owned_);
+    owned_ = addr;
+    init(addr, true);
+}
+
+void RingBuffer::initMirrored()
+{
+    if (capacity_ % MirroredMemory::pageSize() != 0)
+    {
+        throw std::runtime_error(std::string("RingBuffer::initMirrored: capacity not page aligned"));
+    }
+    mirror_.map(sizeof(RingHeader), capacity_);
+    mirrored_ = true;
+    attach(mirror_.header(), mirror_.data(), true);
+}
+
+void RingBuffer::initMirrored(const std::string& name, bool is_new)
+{
+    if (capacity_ % MirroredMemory::pageSize() != 0)
+    {
+        throw std::runtime_error(std::string("RingBuffer::initMirrored: capacity not page aligned"));
+    }
+    mirror_.map(name, sizeof(RingHeader), capacity_, is_new);
+    mirrored_ = true;
+    attach(mirror_.header(), mirror_.data(), is_new);
+}
+
+ssize_t RingBuffer::fillFrom(int fd, off_t offset)
+{
+    size_t free_space = freeSpace();
+    if (free_space == 0)
+    {
+        return 0;
+    }
+    size_t index = write_pos_ & mask_;
+    size_t first = mirrored_ || free_space < capacity_ - index
+        ? free_space : capacity_ - index;
+    struct iovec iov[2];
+    iov[0].iov_base = data_ + index;
+    iov[0].iov_len = first;
+    iov[1].iov_base = data_;
+    iov[1].iov_len = free_space - first;
+    int iov_num = iov[1].iov_len ? 2 : 1;
+    ssize_t n = offset < 0 ? ::readv(fd, iov, iov_num)
+                           : ::preadv(fd, iov, iov_num, offset);
+    if (n > 0)
+    {
+        write_pos_ += n;
+        commit();
+    }
+    return n;
+}
+
+ssize_t RingBuffer::drainTo(int fd, off_t offset)
+{
+    struct iovec iov[2];
+    if (fetch(iov) == 0)
+    {
+        return 0;
+    }
+    int iov_num = iov[1].iov_len ? 2 : 1;
+    ssize_t n = offset < 0 ? ::writev(fd, iov, iov_num)
+                           : ::pwritev(fd, iov, iov_num, offset);
+    if (n > 0)
+    {
+        skip(n);
+        commitRead();
+    }
+    return n;
+}
+
+} // name space tf
@@ -1,184 +1,330 @@
 #pragma once
 
+#include "Platform.h"
+#include "Intrinsics.h"
+#include "MirroredMemory.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <cstring>        // for memcpy
+#include <string>
+#include <string_view>
+#include <sys/types.h>    // for ssize_t and off_t
+#include <sys/uio.h>      // for iovec
+
 namespace tf {
 
+/**
+ * \class RingBuffer
+ * \ingroup IPC
+ * \brief A single producer single consumer byte ring.
+ * The capacity is a power of two and all of it is usable. The write and
+ * read positions are 64-bit byte counters that never wrap, published with
+ * release stores and read with acquire loads, each on its own cache line.
+ * Each side keeps a cached copy of the other side's position and only
+ * reloads it when the cached value says the ring is full or empty, so the
+ * shared cache lines are touched once per batch rather than per call.
+ * Writes are staged and made visible to the reader by commit(), so a
+ * producer can batch many small writes into one publication. Likewise
+ * reads free their space for the writer on commitRead().
+ * Variable length messages can be written in place instead: reserve()
+ * returns room for a message inside the ring and publish() makes it
+ * visible, and the reader gets each message as a view with peek() and
+ * releases it with consume(). A message is stored as an 8 byte record
+ * header holding its length, followed by the payload padded to 8 bytes.
+ * A message never wraps, when it does not fit before the end of the ring
+ * a padding record fills the tail and the message starts over at the
+ * front. Byte and message calls must not be mixed on one ring.
+ * Like SharedQueue, the ring lives in memory of requiredSize() bytes given
+ * to init(), which can be a shared memory segment mapped by the producer
+ * and consumer processes. init() without memory allocates a private ring.
+ * initMirrored() maps the data twice back to back instead (see
+ * MirroredMemory), either privately or in named shared memory. Wrapped
+ * data is then contiguous: fetch() returns a single piece, write and read
+ * copy in one go, and messages need no padding record and can take the
+ * whole capacity.
+ */
 class RingBuffer
 {
-	char*       			buffer_ { nullptr };
-	uint64_t    			buffer_size_ { 0 };
-	uint64_t    			capacity_ { 0 };
-    volatile  uint64_t*	    write_pos_ { nullptr };
-	volatile  uint64_t*     read_pos_ { nullptr };
-	uint64_t                write_pos_cache_ { 0 };
-	uint64_t                read_pos_cache_ { 0 };
-	char*                   data_start_ { nullptr };
-	char*                   data_end_ { nullptr };
-
   public:
-	bool write (const char* buff, uint64_t len)
-	{
-		uint64_t read_pos = *read_pos_;
-		if (*write_pos_ > read_pos)
-		{
-			uint64_t free_space = capacity_ - *write_pos_ + read_pos;
-			if (free_space < len)
-			{
-				// free space is not sufficent
-				return false;
-			}
-			if (capacity_ - *write_pos_ > len)
-			{
-				// tail space is sufficent for the new data
-				memcpy(data_start_ + *write_pos_, buf, len);
-				*write_pos_ += len;
-			}
-			else
-			{
-				// wrap
-				uint64_t end_sz = capacity_ - *write_pos_;
-				if (end_sz>0)
-				{
-					memcpy(data_start_ + *write_pos_, buf, end_sz);
-				}
-				memcpy(data_start_, buf + end_sz, len - end_sz)
-				*write_pos_ = len - end_sz;
-			}
-		}
-		else
-		{
-			if (read_pos - *write_pos_ < len + 1)
-			{
-				return false;
-			}
-			memcpy(data_start_ + *write_pos_, buf, len);
-			*write_pos_ += len;
-		}
-		return true;
-	}
-
-	size_t fetch(struct iovec& iov)
-	{
-        uint64_t wp = *wirte_pos_;
-        size_t data_size;
-        if (wp >= *read_pos_)
+    /// The capacity is rounded up to a power of two
+    explicit RingBuffer(size_t capacity) noexcept(false);
+    ~RingBuffer();
+
+    RingBuffer(const RingBuffer&) = delete;
+    RingBuffer& operator=(const RingBuffer&) = delete;
+
+    /// Returns the size of the memory needed by the ring
+    size_t requiredSize() const;
+
+    /// Attaches to the ring at addr, and builds it when is_new is set.
+    /// Throws if an existing ring was built with a different capacity
+    void init(char* addr, bool is_new) noexcept(false);
+
+    /// Allocates the memory of the ring for use within the process
+    void init() noexcept(false);
+
+    /// Maps the ring with mirrored data, private to the process. The
+    /// capacity must be a multiple of the page size
+    void initMirrored() noexcept(false);
+
+    /// Maps the ring with mirrored data in the named shared memory, which
+    /// is created and built when is_new is set
+    void initMirrored(const std::string& name, bool is_new) noexcept(false);
+
+    bool isMirrored() const { return mirrored_; }
+
+    //-------------------------------------------------------------------------
+    // Producer side
+
+    /// Copies len bytes into the ring, returns false with nothing written
+    /// when there is not enough free space. The bytes are visible to the
+    /// reader after commit()
+    TF_INLINE bool write(const char* buf, size_t len)
+    {
+        if (TF_UNLIKELY(!hasFreeSpace(len)))
+        {
+            return false;
+        }
+        copyIn(write_pos_, buf, len);
+        write_pos_ += len;
+        return true;
+    }
+
+    /// Publishes the bytes written since the last commit
+    TF_INLINE void commit()
+    { header_->write_pos_.store(write_pos_, std::memory_order_release); }
+
+    /// Reads from fd straight into the free space of the ring with one
+    /// readv, or preadv at offset when offset is not negative, and commits
+    /// the bytes read. Returns the number of bytes read, 0 at end of file
+    /// or when the ring is full, and -1 with errno set on error
+    ssize_t fillFrom(int fd, off_t offset = -1);
+
+    /// Returns the free space seen by the producer
+    size_t freeSpace()
+    {
+        read_pos_cache_ = header_->read_pos_.load(std::memory_order_acquire);
+        return capacity_ - (write_pos_ - read_pos_cache_);
+    }
+
+    /// Returns room for a message of len bytes inside the ring, or nullptr
+    /// when there is not enough free space. A message can take at most
+    /// half of the capacity, or all of it when mirrored. The message is not
+    /// visible until publish()
+    TF_INLINE char* reserve(size_t len)
+    {
+        size_t record_size = recordSize(len);
+        size_t index = write_pos_ & mask_;
+        size_t tail = capacity_ - index;
+        size_t padding = !mirrored_ && tail < record_size ? tail : 0;
+        if (TF_UNLIKELY(record_size > max_record_size_ ||
+                        !hasFreeSpace(padding + record_size)))
         {
-            data_size =  wp - *read_pos_;
-            iov[0].iov_base = iov[1].iov_base = data_start_ + *read_pos_;
-            iov[0].iov_len = data_size;
-            iov[1].iov_len = 0;
+            return nullptr;
         }
-        else
+        if (TF_UNLIKELY(padding))
         {
-            // data is wrapped
-            iov[1].iov_base = data_start_;
-            iov[1].iov_len = wp - buffer_start_;
-            iov[0].iov_base = data_start_ + *read_pos_;
-            iov[0].iov_len = capacity_ - *read_pos_);
-            data_size = iov[0].iov_len + iov[1].iov_len;
+            *recordAt(write_pos_) = RecordHeader {uint32_t(padding), RT_Padding};
+            write_pos_ += padding;
         }
-        new_read_pos_ = wp;
-        return data_size;
+        *recordAt(write_pos_) = RecordHeader {uint32_t(len), RT_Message};
+        return reinterpret_cast<char*>(recordAt(write_pos_) + 1);
+    }
+
+    /// Publishes the message given by the last reserve()
+    TF_INLINE void publish()
+    {
+        write_pos_ += recordSize(recordAt(write_pos_)->size_);
+        commit();
     }
 
-	size_t read(char* buf,  uint64_t len)
-	{
-        uint64_t wp = *wirte_pos_;
-        size_t data_size;
-        if (wp >= *read_pos_)
+    /// Publishes the message given by the last reserve() with a length of
+    /// len, which must not be greater than the reserved length
+    TF_INLINE void publish(size_t len)
+    {
+        recordAt(write_pos_)->size_ = uint32_t(len);
+        publish();
+    }
+
+    //-------------------------------------------------------------------------
+    // Consumer side
+
+    /// Returns the next published message, or an empty view with a null
+    /// data pointer when there is none. The message stays in the ring until
+    /// consume()
+    TF_INLINE std::string_view peek()
+    {
+        while (hasData(sizeof(RecordHeader)))
         {
-            data_size =  wp - *read_pos_;
-			if (data_size < len)
-			{
-				return 0;
-			}
-			memcpy(buf, data_start_ + *read_pos_, len);
-			*read_pos_ += len;
-			return len;
+            const RecordHeader* record = recordAt(read_pos_);
+            if (TF_LIKELY(record->type_ == RT_Message))
+            {
+                return std::string_view(reinterpret_cast<const char*>(record + 1),
+                                        record->size_);
+            }
+            read_pos_ += record->size_;
         }
+        return std::string_view();
+    }
 
-		// wrapped case
-		if (capacity_ - *read_pos_ >= len)
-		{
-			memcpy(buf, data_start_ + *read_pos_, len);
-			*read_pos_ += len;
-			if (*read_pos_ >= capacity_)
-			{
-				*read_pos_ = 0;
-			}
-			return len;
-		}
-
-		uint64_t end_sz = capacity_ - *read_pos_;
-		if (end_sz+wp < len)
-		{
-			return 0;
-		}
-		memcpy(buf, data_start_ + *read_pos_, end_sz);
-		memcpy(buf+end_sz, data_start_, len - end_sz);
-		*read_pos_ = len - end_sz;
-        return data_size;
+    /// Releases the message returned by peek()
+    TF_INLINE void consume()
+    {
+        read_pos_ += recordSize(recordAt(read_pos_)->size_);
+        commitRead();
     }
 
-    void commit(uint64_t new_read_pos) { *read_pos_ = new_read_pos; }
-    void commit() { *read_pos_ = new_read_pos_; }
+    /// Copies len bytes out of the ring, returns false with nothing read
+    /// when fewer bytes are committed. The space is given back to the
+    /// writer on commitRead()
+    TF_INLINE bool read(char* buf, size_t len)
+    {
+        if (TF_UNLIKELY(!hasData(len)))
+        {
+            return false;
+        }
+        copyOut(read_pos_, buf, len);
+        read_pos_ += len;
+        return true;
+    }
 
-    size_t size() const
+    /// Points iov at the committed bytes, in two pieces when they wrap in
+    /// a ring that is not mirrored, and returns their total size. The
+    /// bytes stay in the ring until skip() is called
+    size_t fetch(struct iovec (&iov)[2])
     {
-        uint64_t* wp = wirte_pos_;
-        if (wp >= *read_pos_)
-		{
-			return wp - *read_pos_;
-		}
-        else
-		{ 
-		    return capacity - wp + *read_pos_;
-		}
+        size_t size = this->size();
+        size_t index = read_pos_ & mask_;
+        size_t first = mirrored_ || size < capacity_ - index ? size : capacity_ - index;
+        iov[0].iov_base = data_ + index;
+        iov[0].iov_len = first;
+        iov[1].iov_base = data_;
+        iov[1].iov_len = size - first;
+        return size;
     }
 
-   size_t capacity() const {return capacity_ - 1;}
-     
-};
-        
-        
+    /// Consumes len bytes returned by fetch()
+    TF_INLINE void skip(size_t len) { read_pos_ += len; }
 
+    /// Writes the committed bytes to fd straight from the ring with one
+    /// writev, or pwritev at offset when offset is not negative, and
+    /// consumes and commits the bytes actually written. Returns the number
+    /// of bytes written, and -1 with errno set on error
+    ssize_t drainTo(int fd, off_t offset = -1);
 
-class RingBuffer
-{
-	char * buffer_;
-	char * buffer_start_;
-	char * buffer_end_;
-	size_t capacity_;
-	size_t* write_pos_;
-	size_t* read_pos_;
+    /// Gives the space of the bytes read since the last commitRead back to
+    /// the writer
+    TF_INLINE void commitRead()
+    { header_->read_pos_.store(read_pos_, std::memory_order_release); }
 
-  public:
-    virtual int allocBuffer(size_t size) = 0;
-	int initialize(size_t size);
+    /// Returns the number of committed bytes not read yet
+    size_t size()
+    {
+        write_pos_cache_ = header_->write_pos_.load(std::memory_order_acquire);
+        return write_pos_cache_ - read_pos_;
+    }
 
-  public:
-    RingBuffer (size_t size)
-      : size_(1<<log2_ceil(size))
-	  , mask_(size_ - 1)
-	  , buffer_(size_)
-	  , write_pos_(0)
-	  , read_pos_ (0)
-	{}
-
-	bool write (char* data, size_t length);
-	size_t read(char&* data);
-};
+    bool empty() { return size() == 0; }
 
-int RingBuffer::intialize(size_t size)
-{
-	if (allocateBuffer(size) < 0)
-	{
-		return -1;
-	}
-} 
+    //-------------------------------------------------------------------------
+    size_t capacity() const { return capacity_; }
 
-bool RingBuffer::write(char* data, size_t length)
-{
-	if (write_pos_)
-}
+  private:
+    struct RingHeader
+    {
+        constexpr static uint64_t MAGIC_WORD = 0X52494E4742554631ULL;  // RINGBUF1
+
+        uint64_t                magic_word_ {MAGIC_WORD};
+        uint64_t                capacity_;
+        alignas(CPUInfo::cache_alignment_)
+        std::atomic<uint64_t>   write_pos_ {0};
+        alignas(CPUInfo::cache_alignment_)
+        std::atomic<uint64_t>   read_pos_ {0};
+
+        explicit RingHeader(uint64_t capacity): capacity_(capacity) {}
+    };
+
+    enum RecordType: uint32_t
+    {
+        RT_Message = 0,
+        RT_Padding = 1
+    };
+
+    struct RecordHeader
+    {
+        uint32_t    size_;      // of the payload, or of the whole padding
+        uint32_t    type_;
+    };
+
+    TF_INLINE static size_t recordSize(size_t len)
+    { return sizeof(RecordHeader) + constAlign(len, sizeof(RecordHeader)); }
+
+    TF_INLINE RecordHeader* recordAt(uint64_t pos) const
+    { return reinterpret_cast<RecordHeader*>(data_ + (pos & mask_)); }
+
+    void attach(char* header, char* data, bool is_new) noexcept(false);
+
+    TF_INLINE bool hasFreeSpace(size_t len)
+    {
+        if (TF_LIKELY(capacity_ - (write_pos_ - read_pos_cache_) >= len))
+        {
+            return true;
+        }
+        read_pos_cache_ = header_->read_pos_.load(std::memory_order_acquire);
+        return capacity_ - (write_pos_ - read_pos_cache_) >= len;
+    }
+
+    TF_INLINE bool hasData(size_t len)
+    {
+        if (TF_LIKELY(write_pos_cache_ - read_pos_ >= len))
+        {
+            return true;
+        }
+        write_pos_cache_ = header_->write_pos_.load(std::memory_order_acquire);
+        return write_pos_cache_ - read_pos_ >= len;
+    }
+
+    TF_INLINE void copyIn(uint64_t pos, const char* buf, size_t len)
+    {
+        size_t index = pos & mask_;
+        size_t first = mirrored_ || len < capacity_ - index ? len : capacity_ - index;
+        std::memcpy(data_ + index, buf, first);
+        if (TF_UNLIKELY(first < len))
+        {
+            std::memcpy(data_, buf + first, len - first);
+        }
+    }
+
+    TF_INLINE void copyOut(uint64_t pos, char* buf, size_t len) const
+    {
+        size_t index = pos & mask_;
+        size_t first = mirrored_ || len < capacity_ - index ? len : capacity_ - index;
+        std::memcpy(buf, data_ + index, first);
+        if (TF_UNLIKELY(first < len))
+        {
+            std::memcpy(buf + first, data_, len - first);
+        }
+    }
+
+    const size_t    capacity_;
+    const size_t    mask_;
+    RingHeader*     header_ {nullptr};
+    char*           data_ {nullptr};
+    size_t          max_record_size_ {0};
+    bool            mirrored_ {false};
+    char*           owned_ {nullptr};   // allocated by init()
+    MirroredMemory  mirror_;            // mapped by initMirrored()
+
+    // Used by the producer only
+    alignas(CPUInfo::cache_alignment_)
+    uint64_t        write_pos_ {0};     // staged, published by commit
+    uint64_t        read_pos_cache_ {0};
+
+    // Used by the consumer only
+    alignas(CPUInfo::cache_alignment_)
+    uint64_t        read_pos_ {0};      // staged, published by commitRead
+    uint64_t        write_pos_cache_ {0};
+};
 
-}
\ No newline at end of file
+} // namespace tf
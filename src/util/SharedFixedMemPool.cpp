@@ -0,0 +1,212 @@
+#include "SharedFixedMemPool.h"
+#include "Concurrency.h"  // for pause
+#include <algorithm>      // for min
+#include <new>            // for placement new
+#include <stdexcept>      // for runtime_error
+#include <string>         // for string used by runtime_error
+
+namespace tf
+{
+//-----------------------------------------------------------------------------
+// class SharedFixedMemPool
+//-----------------------------------------------------------------------------
+
+// Same layout as FixedMemPool::EntryHeader, so FixedMemPool::refCount and
+// PoolPtr work on shared entries too
+struct SharedFixedMemPool::EntryHeader
+{
+    union
+    {
+        uint64_t           next_free_offset_;
+        uint64_t           uint64_header_;
+        struct
+        {
+            uint64_t        magic_word_   : 16;  // 0XA3C5
+            uint64_t        bin_          : 16;
+            uint64_t        ref_count_    : 32;
+        }
+        header_struct_;
+    };
+
+    static constexpr uint16_t MAGIC_WORD = 0XA3C5;
+
+    void setAllocated(uint16_t bin)
+    {
+        header_struct_.magic_word_ = MAGIC_WORD;
+        header_struct_.bin_ = bin;
+        header_struct_.ref_count_ = 1;
+    }
+};
+
+struct SharedFixedMemPool::PoolHeader
+{
+    constexpr static uint64_t MAGIC_WORD = 0X5346504F4F4C3031ULL;  // SFPOOL01
+
+    uint64_t                magic_word_ {MAGIC_WORD};
+    uint64_t                value_size_;
+    uint64_t                entry_size_;
+    uint64_t                entry_num_;
+    uint64_t                entry_num_per_bucket_;
+    alignas(CPUInfo::cache_alignment_)
+    std::atomic<uint64_t>   head_ {0};          // tag:32 | offset:32
+    alignas(CPUInfo::cache_alignment_)
+    std::atomic<uint64_t>   next_bucket_ {0};   // index of the bucket to carve
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free,
+              "SharedFixedMemPool needs address free 64 bit atomics");
+
+SharedFixedMemPool::SharedFixedMemPool(
+    size_t value_size,
+    size_t entry_num,
+    size_t entry_num_per_bucket
+)
+    : value_size_(value_size)
+    , entry_size_ (sizeof(EntryHeader)+constAlign(value_size,8))
+    , entry_num_(entry_num)
+    , entry_num_per_bucket_(entry_num_per_bucket)
+    , bucket_num_((entry_num+entry_num_per_bucket-1)/entry_num_per_bucket)
+{
+    if (requiredSize() > OFFSET_MASK)
+    {
+        throw std::runtime_error(std::string("SharedFixedMemPool: pool larger than 4GB"));
+    }
+}
+
+size_t SharedFixedMemPool::requiredSize() const
+{
+    return constAlign(sizeof(PoolHeader),CPUInfo::cache_alignment_) +
+           entry_size_*entry_num_;
+}
+
+void SharedFixedMemPool::init(char* addr, bool is_new)
+{
+    base_ = addr;
+    if (is_new)
+    {
+        header_ = new (addr) PoolHeader();
+        header_->value_size_ = value_size_;
+        header_->entry_size_ = entry_size_;
+        header_->entry_num_ = entry_num_;
+        header_->entry_num_per_bucket_ = entry_num_per_bucket_;
+        return;
+    }
+
+    header_ = reinterpret_cast<PoolHeader*>(addr);
+    if (header_->magic_word_ != PoolHeader::MAGIC_WORD ||
+        header_->entry_size_ != entry_size_ ||
+        header_->entry_num_ != entry_num_ ||
+        header_->entry_num_per_bucket_ != entry_num_per_bucket_)
+    {
+        throw std::runtime_error(std::string("SharedFixedMemPool::init: pool layout mismatch"));
+    }
+}
+
+SharedFixedMemPool::EntryHeader* SharedFixedMemPool::pop()
+{
+    uint64_t head = header_->head_.load(std::memory_order_acquire);
+    EntryHeader* entry;
+    do
+    {
+        uint64_t offset = head & OFFSET_MASK;
+        if (!offset)
+        {
+            return nullptr;
+        }
+        // As in ConcurrentFixedMemPool, a stale entry read here only makes
+        // the CAS fail because the tag has moved on
+        entry = entryAt(offset);
+        uint64_t next =
+            __atomic_load_n(&entry->next_free_offset_, __ATOMIC_RELAXED);
+        if (header_->head_.compare_exchange_weak(
+                head, nextHead(head, uint32_t(next)),
+                std::memory_order_acq_rel, std::memory_order_acquire))
+        {
+            return entry;
+        }
+        pause();
+    }
+    while (true);
+}
+
+void SharedFixedMemPool::push(EntryHeader* first, EntryHeader* last)
+{
+    uint64_t head = header_->head_.load(std::memory_order_relaxed);
+    do
+    {
+        __atomic_store_n(&last->next_free_offset_, head & OFFSET_MASK, __ATOMIC_RELAXED);
+    }
+    while (!header_->head_.compare_exchange_weak(
+                head, nextHead(head, toOffset(first)),
+                std::memory_order_release, std::memory_order_relaxed));
+}
+
+// Carves the next bucket from the segment, returns its first entry and
+// pushes the others to the free list. No lock is needed since every caller
+// gets a different bucket index.
+SharedFixedMemPool::EntryHeader* SharedFixedMemPool::newBucket()
+{
+    uint64_t bucket = header_->next_bucket_.load(std::memory_order_relaxed);
+    do
+    {
+        if (bucket >= bucket_num_)
+        {
+            return nullptr;
+        }
+    }
+    while (!header_->next_bucket_.compare_exchange_weak(
+                bucket, bucket+1, std::memory_order_relaxed));
+
+    size_t entry_num = std::min(entry_num_per_bucket_,
+                                entry_num_-bucket*entry_num_per_bucket_);
+    char* p = base_ + constAlign(sizeof(PoolHeader),CPUInfo::cache_alignment_) +
+              bucket*entry_num_per_bucket_*entry_size_;
+    EntryHeader* first = reinterpret_cast<EntryHeader*>(p);
+    if (entry_num > 1)
+    {
+        EntryHeader* entry = reinterpret_cast<EntryHeader*>(p+entry_size_);
+        EntryHeader* second = entry;
+        for (size_t i=2; i<entry_num; ++i)
+        {
+            p += entry_size_;
+            entry->next_free_offset_ = toOffset(p+entry_size_);
+            entry = entryAt(entry->next_free_offset_);
+        }
+        push(second, entry);
+    }
+    return first;
+}
+
+void* SharedFixedMemPool::alloc(uint16_t bin)
+{
+    EntryHeader* entry = pop();
+    if (!entry)
+    {
+        entry = newBucket();
+        if (!entry)
+        {
+            // Another process may have freed entries since the pop
+            entry = pop();
+            if (!entry)
+            {
+                return nullptr;
+            }
+        }
+    }
+    entry->setAllocated(bin);
+    return entry+1;
+}
+
+void SharedFixedMemPool::free(void* p)
+{
+    EntryHeader* cur_head = reinterpret_cast<EntryHeader*>(p) - 1;
+
+    if (EntryHeader::MAGIC_WORD != cur_head->header_struct_.magic_word_)
+    {
+        throw std::runtime_error(std::string("SharedFixedMemPool::free: memory currupted"));
+    }
+
+    push(cur_head, cur_head);
+}
+
+} // name space tf
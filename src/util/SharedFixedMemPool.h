@@ -0,0 +1,78 @@
+#pragma once
+
+#include "Platform.h"
+#include "Intrinsics.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+
+namespace tf
+{
+
+/**
+ * \class SharedFixedMemPool
+ * \ingroup MemPool
+ * \brief A fixed size entry pool living in a shared memory segment.
+ * The pool state and all entries are inside the memory given to init(), so
+ * processes mapping the segment at different addresses share one pool.
+ * Free list links are 32 bit offsets from the start of the segment, and an
+ * entry can be handed to another process as an offset (see toOffset).
+ * Buckets are carved from the segment on demand, no memory is allocated
+ * after init. The free list head packs the offset of the first entry with a
+ * 32 bit version tag, bumped on every update to avoid the ABA problem, so
+ * alloc and free are lock-free across threads and processes.
+ * Like SharedQueue, the owner of the segment asks requiredSize() to size
+ * it, then every user calls init() on its mapping.
+ */
+class SharedFixedMemPool
+{
+  public:
+    SharedFixedMemPool(size_t value_size,
+            size_t entry_num,
+            size_t entry_num_per_bucket = 100) noexcept(false);
+
+    /// Returns the size of the memory needed by the pool
+    size_t requiredSize() const;
+
+    /// Attaches to the pool at addr, and builds it when is_new is set.
+    /// Throws if an existing pool was built with different sizes
+    void init(char* addr, bool is_new) noexcept(false);
+
+    /// Returns nullptr when all the entries in the segment are allocated
+    void* alloc(uint16_t bin = 0) noexcept(false);
+
+    void free(void* p) noexcept(false);
+
+    TF_INLINE uint32_t toOffset(const void* p) const
+    { return uint32_t(reinterpret_cast<const char*>(p) - base_); }
+
+    TF_INLINE void* fromOffset(uint32_t offset) const
+    { return base_ + offset; }
+
+  private:
+    struct EntryHeader;
+    struct PoolHeader;
+
+    constexpr static int      TAG_SHIFT = 32;
+    constexpr static uint64_t OFFSET_MASK = (uint64_t(1) << TAG_SHIFT) - 1;
+
+    TF_INLINE EntryHeader* entryAt(uint64_t offset) const
+    { return reinterpret_cast<EntryHeader*>(base_ + offset); }
+
+    TF_INLINE static uint64_t nextHead(uint64_t head, uint32_t offset)
+    { return ((head & ~OFFSET_MASK) + (uint64_t(1) << TAG_SHIFT)) | offset; }
+
+    EntryHeader* pop();
+    void push(EntryHeader* first, EntryHeader* last);
+    EntryHeader* newBucket();
+
+    size_t          value_size_;
+    size_t          entry_size_;
+    size_t          entry_num_;
+    size_t          entry_num_per_bucket_;
+    size_t          bucket_num_;
+    char*           base_ {nullptr};
+    PoolHeader*     header_ {nullptr};
+};
+
+} // name space tf
@@ -0,0 +1,517 @@
+#include "SharedLog.h"
+#include "Concurrency.h"
+#include <algorithm>      // for min
+#include <chrono>         // for steady_clock
+#include <climits>        // for INT_MAX
+#include <cstring>        // for memcpy and memset
+#include <new>            // for placement new
+#include <stdexcept>      // for runtime_error
+#include <string>         // for string used by runtime_error
+#include <thread>         // for yield
+
+#if (TF_OS_FAMILY==TF_OS_FAMILY_LINUX)
+    #include <linux/futex.h>
+    #include <sys/syscall.h>
+    #include <time.h>
+    #include <unistd.h>
+#endif
+
+namespace tf
+{
+//-----------------------------------------------------------------------------
+// Futex on a word of shared memory, not private to the process
+//-----------------------------------------------------------------------------
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t),
+              "futex needs a plain 32 bit atomic word");
+
+#if (TF_OS_FAMILY==TF_OS_FAMILY_LINUX)
+static void futexWait(std::atomic<uint32_t>& word, uint32_t value, int timeout_ms)
+{
+    struct timespec timeout;
+    timeout.tv_sec = timeout_ms / 1000;
+    timeout.tv_nsec = long(timeout_ms % 1000) * 1000000;
+    ::syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAIT, value,
+              timeout_ms < 0 ? nullptr : &timeout, nullptr, 0);
+}
+
+static void futexWake(std::atomic<uint32_t>& word)
+{
+    ::syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAKE, INT_MAX,
+              nullptr, nullptr, 0);
+}
+#else
+static void futexWait(std::atomic<uint32_t>& word, uint32_t value, int timeout_ms)
+{
+    if (word.load(std::memory_order_acquire) == value)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(
+            timeout_ms < 0 || timeout_ms > 1 ? 1 : timeout_ms));
+    }
+}
+
+static void futexWake(std::atomic<uint32_t>&)
+{
+}
+#endif
+
+//-----------------------------------------------------------------------------
+// class SharedLog
+//-----------------------------------------------------------------------------
+// A slot of the consumer registry. Positions below the capacity, which is
+// where sequences start, mark the state of the slot
+struct SharedLog::ConsumerSlot
+{
+    constexpr static uint64_t FREE = 0;
+    constexpr static uint64_t EVICTED = 1;
+    constexpr static uint64_t CLAIMED = 2;
+
+    alignas(CPUInfo::cache_alignment_)
+    std::atomic<uint64_t>   position_ {FREE};
+    std::atomic<uint32_t>   gating_ {0};
+};
+
+struct SharedLog::LogHeader
+{
+    constexpr static uint64_t MAGIC_WORD = 0X53484C4F47303033ULL;  // SHLOG003
+
+    uint64_t                magic_word_ {MAGIC_WORD};
+    uint64_t                capacity_;
+    uint32_t                policy_;
+    uint32_t                wakeup_;
+    // Sequences start at the capacity, so that the zeroed headers of a new
+    // log never hold a valid sequence
+    alignas(CPUInfo::cache_alignment_)
+    std::atomic<uint64_t>   cursor_;
+    // Producers bump the futex word to wake the readers sleeping on it
+    alignas(CPUInfo::cache_alignment_)
+    std::atomic<uint32_t>   futex_ {0};
+    std::atomic<uint32_t>   waiter_num_ {0};
+    ConsumerSlot            consumers_[MAX_CONSUMERS];
+
+    LogHeader(uint64_t capacity, uint32_t policy, bool wakeup)
+        : capacity_(capacity), policy_(policy), wakeup_(wakeup), cursor_(capacity) {}
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free,
+              "SharedLog needs address free 64 bit atomics");
+
+SharedLog::SharedLog(size_t capacity, SL_Policy policy, bool wakeup)
+    : capacity_(capacity <= 4*RECORD_ALIGNMENT
+                ? 4*RECORD_ALIGNMENT : size_t(1) << (constLog2(capacity-1)+1))
+    , mask_(capacity_-1)
+    , policy_(policy)
+    , wakeup_(wakeup)
+{
+}
+
+size_t SharedLog::requiredSize() const
+{
+    return constAlign(sizeof(LogHeader),CPUInfo::cache_alignment_) + capacity_;
+}
+
+void SharedLog::init(char* addr, bool is_new)
+{
+    data_ = addr + constAlign(sizeof(LogHeader),CPUInfo::cache_alignment_);
+    if (is_new)
+    {
+        std::memset(data_, 0, capacity_);
+        header_ = new (addr) LogHeader(capacity_, uint32_t(policy_), wakeup_);
+    }
+    else
+    {
+        header_ = reinterpret_cast<LogHeader*>(addr);
+        if (header_->magic_word_ != LogHeader::MAGIC_WORD ||
+            header_->capacity_ != capacity_ ||
+            header_->policy_ != uint32_t(policy_) ||
+            header_->wakeup_ != uint32_t(wakeup_))
+        {
+            throw std::runtime_error(std::string("SharedLog::init: log mismatch"));
+        }
+    }
+    gate_pos_.store(0, std::memory_order_relaxed);
+}
+
+uint64_t SharedLog::cursor() const
+{
+    return header_->cursor_.load(std::memory_order_acquire);
+}
+
+SharedLog::ConsumerSlot& SharedLog::consumerAt(size_t consumer) const
+{
+    return header_->consumers_[consumer];
+}
+
+int64_t SharedLog::consumerLag(size_t consumer) const
+{
+    uint64_t position = consumerAt(consumer).position_.load(std::memory_order_acquire);
+    if (position < capacity_)
+    {
+        return -1;
+    }
+    return int64_t(cursor() - position);
+}
+
+void SharedLog::gate(uint64_t end)
+{
+    // The record overwrites what was written a whole log before it
+    uint64_t limit = end - capacity_;
+    if (TF_LIKELY(limit <= gate_pos_.load(std::memory_order_relaxed)))
+    {
+        return;
+    }
+    for (;;)
+    {
+        // Pairs with the fence of a registering reader: either the scan
+        // sees its claimed slot, or the reader starts at a cursor past the
+        // record, so that a consumer not seen here is never overwritten
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        uint64_t slowest = end - sizeof(RecordHeader);
+        bool lagging = false;
+        bool evicted = false;
+        for (ConsumerSlot& slot: header_->consumers_)
+        {
+            uint64_t position = slot.position_.load(std::memory_order_acquire);
+            if (position == ConsumerSlot::CLAIMED)
+            {
+                // Its start is not known yet, wait until it is
+                lagging = true;
+                continue;
+            }
+            if (position < capacity_ || !slot.gating_.load(std::memory_order_relaxed))
+            {
+                continue;
+            }
+            if (position >= limit)
+            {
+                slowest = std::min(slowest, position);
+            }
+            else if (policy_ == SL_Evict &&
+                     slot.position_.compare_exchange_strong(position, ConsumerSlot::EVICTED))
+            {
+                evicted = true;
+            }
+            else
+            {
+                lagging = true;
+            }
+        }
+        if (evicted)
+        {
+            // The eviction must be visible before the overwrite of the
+            // records of the evicted readers, so that their valid() sees
+            // that they are gone
+            std::atomic_thread_fence(std::memory_order_release);
+        }
+        if (!lagging)
+        {
+            // Positions only move forward, so any bound found stays true
+            gate_pos_.store(slowest, std::memory_order_relaxed);
+            return;
+        }
+        std::this_thread::yield();
+    }
+}
+
+void SharedLog::clearNext(uint64_t pos)
+{
+    // Old payload bytes may happen to look like the sequence of the next
+    // record, so its header is cleared before the record before it is
+    // published. A record already published there is left alone
+    std::atomic<uint64_t>& sequence = recordAt(pos)->sequence_;
+    uint64_t value = sequence.load(std::memory_order_relaxed);
+    if (value != pos)
+    {
+        sequence.compare_exchange_strong(value, 0, std::memory_order_relaxed);
+    }
+}
+
+char* SharedLog::reserve(size_t len, uint64_t& sequence)
+{
+    size_t record_size = recordSize(len);
+    if (record_size > capacity_/4)
+    {
+        throw std::runtime_error(std::string("SharedLog::reserve: message too large"));
+    }
+    for (;;)
+    {
+        uint64_t pos = header_->cursor_.fetch_add(record_size, std::memory_order_relaxed);
+        // The new cursor must be visible before the overwrite below, both
+        // of a message and of a padding record, so that readers checking
+        // valid() see that the old record is gone
+        std::atomic_thread_fence(std::memory_order_release);
+        if (policy_ != SL_Overwrite)
+        {
+            // The header cleared after the record is overwritten too
+            gate(pos + record_size + sizeof(RecordHeader));
+        }
+        RecordHeader* record = recordAt(pos);
+        record->size_ = uint32_t(len);
+        if (TF_LIKELY(capacity_ - (pos & mask_) >= record_size))
+        {
+            record->type_ = RT_Message;
+            sequence = pos;
+            return reinterpret_cast<char*>(record + 1);
+        }
+        // The record would wrap, the allocation becomes a padding record
+        record->size_ = uint32_t(record_size);
+        record->type_ = RT_Padding;
+        clearNext(pos + record_size);
+        record->sequence_.store(pos, std::memory_order_release);
+    }
+}
+
+void SharedLog::publish(uint64_t sequence)
+{
+    RecordHeader* record = recordAt(sequence);
+    clearNext(sequence + recordSize(record->size_));
+    record->sequence_.store(sequence, std::memory_order_release);
+    if (wakeup_)
+    {
+        // Pairs with the fence of a reader going to sleep: either the
+        // reader sees the record, or the producer sees the reader
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (TF_UNLIKELY(header_->waiter_num_.load(std::memory_order_relaxed) != 0))
+        {
+            wake();
+        }
+    }
+}
+
+void SharedLog::wake()
+{
+    header_->futex_.fetch_add(1, std::memory_order_release);
+    futexWake(header_->futex_);
+}
+
+void SharedLog::write(const char* buf, size_t len)
+{
+    uint64_t sequence;
+    std::memcpy(reserve(len, sequence), buf, len);
+    publish(sequence);
+}
+
+//-----------------------------------------------------------------------------
+// class SharedLog::Reader
+//-----------------------------------------------------------------------------
+SharedLog::Reader::Reader(const SharedLog& log)
+    : log_(log)
+    , read_pos_(log.cursor())
+{
+}
+
+SharedLog::Reader::Reader(const SharedLog& log, bool gating)
+    : log_(log)
+    , read_pos_(0)
+{
+    for (size_t i=0; i<MAX_CONSUMERS; ++i)
+    {
+        ConsumerSlot& slot = log.consumerAt(i);
+        uint64_t expected = ConsumerSlot::FREE;
+        if (slot.position_.compare_exchange_strong(expected, ConsumerSlot::CLAIMED))
+        {
+            slot.gating_.store(gating, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            read_pos_ = log.cursor();
+            slot.position_.store(read_pos_);
+            consumer_id_ = int(i);
+            committed_pos_ = read_pos_;
+            guarded_ = gating && log.policy_ != SL_Overwrite;
+            return;
+        }
+    }
+    throw std::runtime_error(std::string("SharedLog::Reader: no free consumer slot"));
+}
+
+SharedLog::Reader::~Reader()
+{
+    if (consumer_id_ >= 0)
+    {
+        log_.consumerAt(consumer_id_).position_.store(ConsumerSlot::FREE,
+                                                      std::memory_order_release);
+    }
+}
+
+bool SharedLog::Reader::evicted() const
+{
+    return consumer_id_ >= 0 &&
+           log_.consumerAt(consumer_id_).position_.load(std::memory_order_acquire) ==
+           ConsumerSlot::EVICTED;
+}
+
+void SharedLog::Reader::commitPosition()
+{
+    if (consumer_id_ < 0 || committed_pos_ == read_pos_)
+    {
+        return;
+    }
+    std::atomic<uint64_t>& position = log_.consumerAt(consumer_id_).position_;
+    if (log_.policy_ != SL_Evict)
+    {
+        position.store(read_pos_, std::memory_order_release);
+        committed_pos_ = read_pos_;
+        return;
+    }
+    // Fails, leaving the slot evicted, when a producer evicted the reader
+    uint64_t expected = committed_pos_;
+    if (position.compare_exchange_strong(expected, read_pos_, std::memory_order_release,
+                                         std::memory_order_relaxed))
+    {
+        committed_pos_ = read_pos_;
+    }
+}
+
+void SharedLog::Reader::skipOverrun()
+{
+    read_pos_ = log_.cursor();
+    ++overrun_num_;
+}
+
+std::string_view SharedLog::Reader::peek()
+{
+    for (;;)
+    {
+        // Producers do not overwrite a guarded reader, which only needs the
+        // sequence of the record
+        if (!guarded_)
+        {
+            uint64_t cursor = log_.cursor();
+            if (TF_UNLIKELY(cursor - read_pos_ > log_.capacity_))
+            {
+                skipOverrun();
+                continue;
+            }
+            if (read_pos_ == cursor)
+            {
+                return std::string_view();
+            }
+        }
+        const RecordHeader* record = log_.recordAt(read_pos_);
+        if (record->sequence_.load(std::memory_order_acquire) != read_pos_)
+        {
+            return std::string_view();
+        }
+        uint32_t size = record->size_;
+        uint32_t type = record->type_;
+        // The header fields are only trusted if the record was not
+        // overwritten while they were read
+        if (TF_UNLIKELY(!valid()))
+        {
+            if (guarded_)
+            {
+                return std::string_view();
+            }
+            skipOverrun();
+            continue;
+        }
+        if (type == RT_Padding)
+        {
+            // Lets producers waiting on the reader use the padding
+            read_pos_ += size;
+            commitPosition();
+            continue;
+        }
+        record_size_ = recordSize(size);
+        return std::string_view(reinterpret_cast<const char*>(record + 1), size);
+    }
+}
+
+bool SharedLog::Reader::valid() const
+{
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (guarded_)
+    {
+        // Producers evict a reader before overwriting its records
+        return log_.policy_ == SL_Block ||
+               log_.consumerAt(consumer_id_).position_.load(std::memory_order_relaxed) ==
+               committed_pos_;
+    }
+    return log_.header_->cursor_.load(std::memory_order_relaxed) - read_pos_ <= log_.capacity_;
+}
+
+void SharedLog::Reader::consume()
+{
+    read_pos_ += record_size_;
+    record_size_ = 0;
+    commitPosition();
+}
+
+bool SharedLog::Reader::wait(int timeout_ms)
+{
+    if (!log_.wakeup_)
+    {
+        throw std::runtime_error(std::string("SharedLog::Reader::wait: log without wakeup"));
+    }
+    constexpr int SPIN_NUM = 256;
+    for (int i=0; i<SPIN_NUM; ++i)
+    {
+        if (peek().data() != nullptr)
+        {
+            return true;
+        }
+        pause();
+    }
+
+    using Clock = std::chrono::steady_clock;
+    Clock::time_point deadline = Clock::now() + std::chrono::milliseconds(timeout_ms);
+    LogHeader& header = *log_.header_;
+    for (;;)
+    {
+        if (evicted())
+        {
+            return false;
+        }
+        // A wake between reading the word and sleeping makes the sleep
+        // return at once
+        uint32_t word = header.futex_.load(std::memory_order_acquire);
+        header.waiter_num_.fetch_add(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        bool ready = peek().data() != nullptr;
+        if (!ready)
+        {
+            int wait_ms = timeout_ms < 0 ? -1 : int(std::max<int64_t>(0,
+                std::chrono::ceil<std::chrono::milliseconds>(deadline - Clock::now()).count()));
+            if (wait_ms != 0)
+            {
+                futexWait(header.futex_, word, wait_ms);
+            }
+        }
+        header.waiter_num_.fetch_sub(1, std::memory_order_relaxed);
+        if (ready)
+        {
+            return true;
+        }
+        if (timeout_ms >= 0 && Clock::now() >= deadline)
+        {
+            return peek().data() != nullptr;
+        }
+    }
+}
+
+size_t SharedLog::Reader::read(char* buf, size_t size)
+{
+    for (;;)
+    {
+        std::string_view msg = peek();
+        if (msg.data() == nullptr)
+        {
+            return 0;
+        }
+        if (msg.size() > size)
+        {
+            throw std::runtime_error(std::string("SharedLog::Reader::read: buffer too small"));
+        }
+        std::memcpy(buf, msg.data(), msg.size());
+        if (TF_LIKELY(valid()))
+        {
+            consume();
+            return msg.size();
+        }
+        if (guarded_)
+        {
+            return 0;
+        }
+        skipOverrun();
+    }
+}
+
+} // name space tf
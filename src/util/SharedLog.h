@@ -0,0 +1,221 @@
+#pragma once
+
+#include "Platform.h"
+#include "Intrinsics.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <string_view>
+
+namespace tf
+{
+
+/// What producers do about a gating consumer of a SharedLog that is a whole
+/// log behind
+enum SL_Policy: uint8_t
+{
+    SL_Overwrite = 0,
+    SL_Block = 1,
+    SL_Evict = 2
+};
+
+/**
+ * \class SharedLog
+ * \ingroup IPC
+ * \brief A multi producer broadcast log of variable length messages in
+ * shared memory.
+ * Unlike SharedQueue, which gives every message a slot of the largest
+ * size, a message takes only its own length rounded up to 16 bytes plus
+ * a 16 byte record header. Producers in any thread or process allocate
+ * records with an atomic fetch-add on a byte cursor. Once every byte of
+ * the log has been written the oldest records are overwritten, and
+ * producers never wait for readers.
+ * The record header holds the byte position of the record, which is its
+ * sequence. It is stored with release semantics only after the payload is
+ * written, so a reader that finds the expected sequence in a header sees
+ * a complete record. Readers never write to the log, and each one keeps
+ * its own position in a Reader. A Reader checks that a record has not
+ * been overwritten by comparing its sequence with the cursor, and moves
+ * to the newest record when it has fallen a whole log behind.
+ * A record never wraps. When a record does not fit before the end of the
+ * log, its producer fills the tail with a padding record and allocates
+ * again.
+ * Like SharedQueue, the owner of the segment asks requiredSize() to size
+ * it, then every user calls init() on its mapping.
+ * A Reader can register in the consumer registry of the log, a cache line
+ * per consumer holding its read position, which gives its lag to
+ * monitoring. A registered reader may be gating, and the policy of the log
+ * decides what producers do about a gating reader that is a whole log
+ * behind: SL_Overwrite overwrites its messages like those of any other
+ * reader, SL_Block waits for it to catch up, so it never misses a message,
+ * and SL_Evict removes it from the registry, after which it reads nothing
+ * and reports evicted().
+ * A log built with wakeup lets a reader with nothing to read wait()
+ * instead of polling. It spins for a short while, then sleeps on a futex
+ * word in the log header, which works across processes. Sleeping readers
+ * are counted, and a producer only makes the wake system call when the
+ * count is not zero, but every publish then costs a full fence and a load
+ * of the count. A log without wakeup keeps the plain busy polled publish.
+ */
+class SharedLog
+{
+  public:
+    constexpr static size_t RECORD_ALIGNMENT = 16;
+    constexpr static size_t MAX_CONSUMERS = 16;
+
+    /// The capacity is rounded up to a power of two
+    explicit SharedLog(size_t capacity,
+                       SL_Policy policy = SL_Overwrite,
+                       bool wakeup = false) noexcept(false);
+
+    /// Returns the size of the memory needed by the log
+    size_t requiredSize() const;
+
+    /// Attaches to the log at addr, and builds it when is_new is set.
+    /// Throws if an existing log was built with a different capacity,
+    /// policy or wakeup
+    void init(char* addr, bool is_new) noexcept(false);
+
+    /// Returns room for a message of len bytes and its sequence. The
+    /// message can be read once published. A message can take at most a
+    /// quarter of the capacity
+    char* reserve(size_t len, uint64_t& sequence) noexcept(false);
+
+    /// Publishes the message reserved with the sequence
+    void publish(uint64_t sequence);
+
+    /// Copies a message into the log and publishes it
+    void write(const char* buf, size_t len) noexcept(false);
+
+    size_t capacity() const { return capacity_; }
+    SL_Policy policy() const { return policy_; }
+    bool hasWakeup() const { return wakeup_; }
+
+    /// Returns the sequence the next record will get
+    uint64_t cursor() const;
+
+    /// Returns the number of bytes the registered consumer has still to
+    /// read, or -1 when no consumer holds the slot
+    int64_t consumerLag(size_t consumer) const;
+
+    //-------------------------------------------------------------------------
+    /**
+     * \class Reader
+     * \brief The position of one reader in a SharedLog.
+     * peek() returns the next message in place. The producers may
+     * overwrite it while it is read, so a reader that parses the message
+     * in place checks valid() afterwards, and drops what it parsed when
+     * the message was overwritten.
+     */
+    class Reader
+    {
+      public:
+        /// Starts after the last message written
+        explicit Reader(const SharedLog& log);
+
+        /// Starts after the last message written, registered as a consumer
+        /// of the log. Throws when all the slots are taken
+        Reader(const SharedLog& log, bool gating) noexcept(false);
+        ~Reader();
+
+        Reader(const Reader&) = delete;
+        Reader& operator=(const Reader&) = delete;
+
+        /// Returns the next message, or an empty view with a null data
+        /// pointer when there is none
+        std::string_view peek();
+
+        /// Returns false when the message returned by peek() has been
+        /// overwritten since
+        bool valid() const;
+
+        /// Moves past the message returned by peek()
+        void consume();
+
+        /// Waits for the next message, spinning before going to sleep.
+        /// Returns true when peek() has a message, and false on timeout or
+        /// once evicted. A negative timeout waits forever. Throws if the
+        /// log was built without wakeup
+        bool wait(int timeout_ms = -1) noexcept(false);
+
+        /// Copies the next message into buf and returns its length, or 0
+        /// when there is none. Throws if the message is larger than size.
+        /// Overwritten messages are skipped
+        size_t read(char* buf, size_t size) noexcept(false);
+
+        uint64_t sequence() const { return read_pos_; }
+
+        /// Number of times the reader fell a whole log behind and skipped
+        /// to the newest message
+        uint64_t overrunCount() const { return overrun_num_; }
+
+        /// Returns the slot of a registered reader, or -1
+        int consumerId() const { return consumer_id_; }
+
+        /// Returns true once producers have evicted the reader
+        bool evicted() const;
+
+      private:
+        /// Moves to the newest record after falling a whole log behind
+        void skipOverrun();
+
+        /// Publishes the read position of a registered reader
+        void commitPosition();
+
+        const SharedLog&    log_;
+        uint64_t            read_pos_;
+        size_t              record_size_ {0};   // of the peeked message
+        uint64_t            overrun_num_ {0};
+        int                 consumer_id_ {-1};
+        uint64_t            committed_pos_ {0}; // in the consumer slot
+        bool                guarded_ {false};   // producers never overrun it
+    };
+
+  private:
+    struct LogHeader;
+    struct ConsumerSlot;
+
+    enum RecordType: uint32_t
+    {
+        RT_Message = 0,
+        RT_Padding = 1
+    };
+
+    struct RecordHeader
+    {
+        std::atomic<uint64_t>   sequence_;  // set last, on publish
+        uint32_t                size_;      // of the payload, or the padding
+        uint32_t                type_;
+    };
+    static_assert(sizeof(RecordHeader) == RECORD_ALIGNMENT);
+
+    TF_INLINE static size_t recordSize(size_t len)
+    { return sizeof(RecordHeader) + constAlign(len, RECORD_ALIGNMENT); }
+
+    TF_INLINE RecordHeader* recordAt(uint64_t pos) const
+    { return reinterpret_cast<RecordHeader*>(data_ + (pos & mask_)); }
+
+    /// Marks the header after a record as unpublished, unless the record
+    /// there has already been published
+    void clearNext(uint64_t pos);
+
+    /// Makes sure gating consumers have read every record before end, by
+    /// waiting or evicting as the policy says
+    void gate(uint64_t end);
+
+    ConsumerSlot& consumerAt(size_t consumer) const;
+
+    /// Wakes the readers sleeping in Reader::wait()
+    void wake();
+
+    const size_t            capacity_;
+    const size_t            mask_;
+    const SL_Policy         policy_;
+    const bool              wakeup_;
+    LogHeader*              header_ {nullptr};
+    char*                   data_ {nullptr};
+    // Every gating consumer is known to have read up to here
+    std::atomic<uint64_t>   gate_pos_ {0};
+};
+
+} // name space tf
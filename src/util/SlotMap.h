@@ -0,0 +1,192 @@
+#pragma once
+
+#include "Platform.h"
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace tf
+{
+
+/**
+ * \class SlotMap
+ * \ingroup MemPool
+ * \brief Dense object storage addressed by generation checked handles.
+ * Objects live contiguously in one array, so iterating all of them is a
+ * linear scan. A handle is a 64-bit value made of a slot index and the
+ * slot's generation. The generation is bumped whenever the slot's object
+ * is erased, so a handle kept after the erase is detected as stale by
+ * get() instead of reaching another object, unlike a raw pointer into a
+ * pool entry.
+ * erase() moves the last object into the hole, so pointers to objects
+ * and iteration order are not stable across erase(), handles are. Handle
+ * 0 is never handed out.
+ */
+template <typename T, class Allocator = std::allocator<T> >
+class SlotMap
+{
+  public:
+    using Handle = uint64_t;
+    using iterator = T*;
+    using const_iterator = const T*;
+
+    constexpr static Handle NULL_HANDLE = 0;
+
+    SlotMap() = default;
+    explicit SlotMap(size_t capacity) { reserve(capacity); }
+
+    void reserve(size_t capacity)
+    {
+        values_.reserve(capacity);
+        value_slots_.reserve(capacity);
+        slots_.reserve(capacity);
+    }
+
+    /// Constructs an object and returns its handle
+    template <typename... Args>
+    Handle emplace(Args&&... args) noexcept(false)
+    {
+        if (free_head_ == END)
+        {
+            if (TF_UNLIKELY(slots_.size() >= END))
+            {
+                throw std::runtime_error(std::string("SlotMap::emplace: too many slots"));
+            }
+            slots_.push_back(Slot {END, 1});
+            free_head_ = uint32_t(slots_.size()-1);
+        }
+        value_slots_.push_back(free_head_);
+        try
+        {
+            values_.emplace_back(std::forward<Args>(args)...);
+        }
+        catch (...)
+        {
+            value_slots_.pop_back();
+            throw;
+        }
+        uint32_t index = free_head_;
+        Slot& slot = slots_[index];
+        free_head_ = slot.value_;
+        slot.value_ = uint32_t(values_.size()-1);
+        return makeHandle(index, slot.generation_);
+    }
+
+    Handle insert(const T& value) { return emplace(value); }
+    Handle insert(T&& value) { return emplace(std::move(value)); }
+
+    /// Returns nullptr when the handle is stale or was never handed out
+    TF_INLINE T* get(Handle handle)
+    {
+        const Slot* slot = find(handle);
+        return slot ? &values_[slot->value_] : nullptr;
+    }
+
+    TF_INLINE const T* get(Handle handle) const
+    {
+        const Slot* slot = find(handle);
+        return slot ? &values_[slot->value_] : nullptr;
+    }
+
+    bool contains(Handle handle) const { return find(handle) != nullptr; }
+
+    /// Destroys the object of the handle, returns false when it is stale
+    bool erase(Handle handle)
+    {
+        const Slot* found = find(handle);
+        if (!found)
+        {
+            return false;
+        }
+        uint32_t index = slotIndex(handle);
+        uint32_t pos = found->value_;
+        uint32_t last = uint32_t(values_.size()-1);
+        if (pos != last)
+        {
+            values_[pos] = std::move(values_[last]);
+            value_slots_[pos] = value_slots_[last];
+            slots_[value_slots_[pos]].value_ = pos;
+        }
+        values_.pop_back();
+        value_slots_.pop_back();
+
+        Slot& slot = slots_[index];
+        // Generation 0 is skipped so that no handle is ever NULL_HANDLE
+        slot.generation_ = slot.generation_+1 == 0 ? 1 : slot.generation_+1;
+        slot.value_ = free_head_;
+        free_head_ = index;
+        return true;
+    }
+
+    void clear()
+    {
+        while (!values_.empty())
+        {
+            erase(handleAt(values_.size()-1));
+        }
+    }
+
+    /// Handle of the object at a position of the dense array
+    Handle handleAt(size_t pos) const
+    {
+        uint32_t index = value_slots_[pos];
+        return makeHandle(index, slots_[index].generation_);
+    }
+
+    size_t size() const { return values_.size(); }
+    bool empty() const { return values_.empty(); }
+
+    T* data() { return values_.data(); }
+    const T* data() const { return values_.data(); }
+    iterator begin() { return values_.data(); }
+    iterator end() { return values_.data() + values_.size(); }
+    const_iterator begin() const { return values_.data(); }
+    const_iterator end() const { return values_.data() + values_.size(); }
+
+  private:
+    using IndexAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<uint32_t>;
+
+    /// value_ is the position in values_ when the slot is used, otherwise
+    /// the next free slot
+    struct Slot
+    {
+        uint32_t    value_;
+        uint32_t    generation_;
+    };
+    using SlotAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<Slot>;
+
+    constexpr static uint32_t END = UINT32_MAX;
+
+    TF_INLINE static Handle makeHandle(uint32_t index, uint32_t generation)
+    {
+        return (Handle(generation) << 32) | index;
+    }
+
+    TF_INLINE static uint32_t slotIndex(Handle handle) { return uint32_t(handle); }
+
+    TF_INLINE const Slot* find(Handle handle) const
+    {
+        uint32_t index = slotIndex(handle);
+        if (TF_UNLIKELY(index >= slots_.size()))
+        {
+            return nullptr;
+        }
+        // A free slot already has the generation of its next handle, and
+        // keeps it when an emplace into it throws, so the slot must also
+        // hold a value
+        const Slot& slot = slots_[index];
+        return slot.generation_ == uint32_t(handle >> 32) &&
+               slot.value_ < values_.size() &&
+               value_slots_[slot.value_] == index ? &slot : nullptr;
+    }
+
+    std::vector<T, Allocator>                   values_;
+    std::vector<uint32_t, IndexAllocator>       value_slots_;   // slot of each value
+    std::vector<Slot, SlotAllocator>            slots_;
+    uint32_t                                    free_head_ {END};
+};
+
+} // name space tf
@@ -103,7 +103,8 @@ class SortedArray
     }
 };
 
-template <typename Key, typename T, class Compare>
+template <typename Key, typename T, class Compare,
+          class Allocator = std::allocator<std::pair<Key, T> > >
 class SortedBukets
 {
   public:
@@ -112,7 +113,7 @@ class SortedBukets
     using pointer = value_type*;
   protected:
 
-    std::vector<value_type>   buckets_;
+    std::vector<value_type, Allocator>   buckets_;
     size_t head_;
     size_t tail_;
 
@@ -0,0 +1,202 @@
+#include "ThreadMemPool.h"
+#include <algorithm>      // for max and swap
+#include <stdexcept>      // for runtime_error
+#include <string>         // for string used by runtime_error
+
+namespace tf
+{
+//-----------------------------------------------------------------------------
+// class MagazineDepot
+//-----------------------------------------------------------------------------
+MagazineDepot& MagazineDepot::instance()
+{
+    static MagazineDepot s_depot;
+    return s_depot;
+}
+
+MagazineDepot::~MagazineDepot()
+{
+    for (Bin& bin: bins_)
+    {
+        while (bin.loaded_)
+        {
+            Magazine* mag = bin.loaded_;
+            bin.loaded_ = mag->next_;
+            delete mag;
+        }
+        delete bin.pool_;
+    }
+    while (empty_)
+    {
+        Magazine* mag = empty_;
+        empty_ = mag->next_;
+        delete mag;
+    }
+}
+
+MagazineDepot::Magazine* MagazineDepot::getEmpty()
+{
+    {
+        ScopedSpinLock lock(empty_mutex_);
+        if (empty_)
+        {
+            Magazine* mag = empty_;
+            empty_ = mag->next_;
+            return mag;
+        }
+    }
+    return new Magazine;
+}
+
+void MagazineDepot::putEmpty(Magazine* mag)
+{
+    ScopedSpinLock lock(empty_mutex_);
+    mag->next_ = empty_;
+    empty_ = mag;
+}
+
+void MagazineDepot::fill(size_t bin, Magazine* mag)
+{
+    Bin& depot_bin = bins_[bin];
+    ScopedSpinLock lock(depot_bin.mutex_);
+    if (nullptr == depot_bin.pool_)
+    {
+        size_t entry_num_per_bucket =
+            std::max(MAGAZINE_SIZE, MemPool::binEntryNum(bin));
+        depot_bin.pool_ =
+            new FixedMemPool(MemPool::binSize(bin), entry_num_per_bucket);
+    }
+    depot_bin.pool_->allocN(mag->entries_+mag->count_,
+                            MAGAZINE_SIZE-mag->count_, bin);
+    mag->count_ = MAGAZINE_SIZE;
+}
+
+MagazineDepot::Magazine* MagazineDepot::exchangeEmpty(size_t bin, Magazine* empty)
+{
+    Magazine* loaded = nullptr;
+    {
+        Bin& depot_bin = bins_[bin];
+        ScopedSpinLock lock(depot_bin.mutex_);
+        if (depot_bin.loaded_)
+        {
+            loaded = depot_bin.loaded_;
+            depot_bin.loaded_ = loaded->next_;
+        }
+    }
+
+    if (loaded)
+    {
+        if (empty)
+        {
+            putEmpty(empty);
+        }
+        return loaded;
+    }
+
+    // No loaded magazine in the depot, fill the given one from the pool
+    loaded = empty ? empty : getEmpty();
+    try
+    {
+        fill(bin, loaded);
+    }
+    catch (...)
+    {
+        if (loaded->empty())
+        {
+            putEmpty(loaded);
+            throw;
+        }
+    }
+    return loaded;
+}
+
+MagazineDepot::Magazine* MagazineDepot::exchangeFull(size_t bin, Magazine* full)
+{
+    if (full)
+    {
+        putBack(bin, full);
+    }
+    return getEmpty();
+}
+
+void MagazineDepot::putBack(size_t bin, Magazine* mag)
+{
+    if (mag->empty())
+    {
+        putEmpty(mag);
+        return;
+    }
+    Bin& depot_bin = bins_[bin];
+    ScopedSpinLock lock(depot_bin.mutex_);
+    mag->next_ = depot_bin.loaded_;
+    depot_bin.loaded_ = mag;
+}
+
+//-----------------------------------------------------------------------------
+// class ThreadMemPool
+//-----------------------------------------------------------------------------
+ThreadMemPool& ThreadMemPool::instance()
+{
+    thread_local ThreadMemPool s_pool;
+    return s_pool;
+}
+
+ThreadMemPool::~ThreadMemPool()
+{
+    MagazineDepot& depot = MagazineDepot::instance();
+    for (size_t bin=0; bin<MemPool::POOL_NUMBER; ++bin)
+    {
+        if (slots_[bin].loaded_) depot.putBack(bin, slots_[bin].loaded_);
+        if (slots_[bin].previous_) depot.putBack(bin, slots_[bin].previous_);
+    }
+}
+
+void ThreadMemPool::reload(Slot& slot, size_t bin)
+{
+    if (slot.previous_ && !slot.previous_->empty())
+    {
+        std::swap(slot.loaded_, slot.previous_);
+        return;
+    }
+    // Both magazines are empty (or not there yet): keep one as previous
+    // and trade the other for a loaded magazine from the depot
+    Magazine* spare = slot.previous_;
+    slot.previous_ = slot.loaded_;
+    slot.loaded_ = nullptr;
+    slot.loaded_ = MagazineDepot::instance().exchangeEmpty(bin, spare);
+}
+
+void ThreadMemPool::unload(Slot& slot, size_t bin)
+{
+    if (slot.previous_ && !slot.previous_->full())
+    {
+        std::swap(slot.loaded_, slot.previous_);
+        return;
+    }
+    // Both magazines are full (or not there yet): keep one as previous
+    // and trade the other for an empty magazine from the depot
+    Magazine* full = slot.previous_;
+    slot.previous_ = slot.loaded_;
+    slot.loaded_ = MagazineDepot::instance().exchangeFull(bin, full);
+}
+
+void* ThreadMemPool::alloc(size_t size)
+{
+    if (size > MemPool::MAX_VALUE_SIZE)
+    {
+        throw std::runtime_error(std::string("ThreadMemPool::alloc: size too big"));
+    }
+    return popEntry(MemPool::sizeToBin(size));
+}
+
+void ThreadMemPool::free(void* p)
+{
+    size_t bin = FixedMemPool::entryBin(p);
+    if (bin >= MemPool::POOL_NUMBER)
+    {
+        throw std::runtime_error(std::string("ThreadMemPool::free: currupted memory"));
+    }
+    pushEntry(bin, p);
+}
+
+} // name space tf
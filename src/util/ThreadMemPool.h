@@ -0,0 +1,145 @@
+#pragma once
+
+#include "FixedMemPool.h"
+#include "Concurrency.h"
+
+namespace tf
+{
+
+/**
+ * \class MagazineDepot
+ * \ingroup MemPool
+ * \brief Central depot shared by all ThreadMemPool instances.
+ * The depot owns one FixedMemPool per MemPool bin and trades whole
+ * magazines (batches of entries) with the thread caches. It is the only
+ * place where a lock is taken, and only when a thread cache runs out of
+ * entries or has too many of them.
+ */
+class MagazineDepot
+{
+  public:
+    constexpr static size_t MAGAZINE_SIZE = 64;
+
+    struct Magazine
+    {
+        Magazine*   next_ {nullptr};
+        size_t      count_ {0};
+        void*       entries_[MAGAZINE_SIZE];
+
+        bool empty() const { return count_ == 0; }
+        bool full() const { return count_ == MAGAZINE_SIZE; }
+    };
+
+    static MagazineDepot& instance();
+
+    /// Trades an empty magazine for a loaded one. If the depot has no loaded
+    /// magazine in the bin, it fills one from the backing pool
+    Magazine* exchangeEmpty(size_t bin, Magazine* empty) noexcept(false);
+
+    /// Trades a loaded magazine for an empty one
+    Magazine* exchangeFull(size_t bin, Magazine* full);
+
+    /// Gives a magazine back to the depot, used when a thread exits
+    void putBack(size_t bin, Magazine* mag);
+
+  private:
+    MagazineDepot() = default;
+    ~MagazineDepot();
+
+    Magazine* getEmpty();
+    void putEmpty(Magazine* mag);
+    void fill(size_t bin, Magazine* mag) noexcept(false);
+
+    struct Bin
+    {
+        SpinMutex       mutex_;
+        Magazine*       loaded_ {nullptr};
+        FixedMemPool*   pool_ {nullptr};
+    };
+
+    Bin             bins_[MemPool::POOL_NUMBER];
+    SpinMutex       empty_mutex_;
+    Magazine*       empty_ {nullptr};
+};
+
+//-----------------------------------------------------------------------------
+/**
+ * \class ThreadMemPool
+ * \ingroup MemPool
+ * \brief Per thread magazine cache in front of the MemPool bins.
+ * Each thread holds two magazines per bin. acq/del only touch the thread
+ * local magazines and take no lock. When both magazines of a bin are empty
+ * (or full) the thread trades one of them with the MagazineDepot, so memory
+ * freed on one thread can be reused by another.
+ * An entry allocated from ThreadMemPool can be released on any thread but
+ * must be released to ThreadMemPool, not to MemPool.
+ */
+class ThreadMemPool
+{
+  public:
+    using Magazine = MagazineDepot::Magazine;
+
+    static ThreadMemPool& instance();
+
+    template <typename T, typename... Args>
+    T* acq(Args... args) noexcept(false)
+    {
+        constexpr size_t sz_aligned = constAlign(sizeof(T),8);
+        static_assert (sz_aligned <= MemPool::MAX_VALUE_SIZE);
+        constexpr uint32_t pool_index = MemPool::binIndex(sz_aligned);
+        void *p = popEntry(pool_index);
+        return p ? new(p)T(args...) : (T*)nullptr;
+    }
+
+    template <typename T>
+    void del(T* p) noexcept(false)
+    {
+        if (p)
+        {
+            constexpr size_t sz_aligned = constAlign(sizeof(T),8);
+            constexpr uint32_t pool_index = MemPool::binIndex(sz_aligned);
+            p->~T();
+            pushEntry(pool_index, (void*)p);
+        }
+    }
+
+    void* alloc(size_t size) noexcept(false);
+    void free(void* p) noexcept(false);
+
+  private:
+    ThreadMemPool() = default;
+    ~ThreadMemPool();
+
+    TF_INLINE void* popEntry(size_t bin) noexcept(false)
+    {
+        Slot& slot = slots_[bin];
+        if (TF_UNLIKELY(!slot.loaded_ || slot.loaded_->empty()))
+        {
+            reload(slot, bin);
+        }
+        return slot.loaded_->entries_[--slot.loaded_->count_];
+    }
+
+    TF_INLINE void pushEntry(size_t bin, void* p) noexcept(false)
+    {
+        Slot& slot = slots_[bin];
+        if (TF_UNLIKELY(!slot.loaded_ || slot.loaded_->full()))
+        {
+            unload(slot, bin);
+        }
+        slot.loaded_->entries_[slot.loaded_->count_++] = p;
+    }
+
+    struct Slot
+    {
+        Magazine*   loaded_ {nullptr};
+        Magazine*   previous_ {nullptr};
+    };
+
+    void reload(Slot& slot, size_t bin) noexcept(false);
+    void unload(Slot& slot, size_t bin);
+
+    Slot    slots_[MemPool::POOL_NUMBER];
+};
+
+} // name space tf
@@ -0,0 +1,448 @@
+// Allocator micro-benchmarks of the tf_util pools against malloc/free and
+// std::pmr pool resources.
+//
+// Scenarios, all on 64 byte objects:
+//   lifo      allocate a window of objects, free them in reverse order
+//   fifo      allocate a window of objects, free them in allocation order
+//   random    free or allocate a random slot of a live set
+//   xthread   a producer thread allocates, a consumer thread frees
+//
+// Latency is sampled per batch of BATCH operations, so p99 is the 99th
+// percentile of the average cost of an operation within a batch. Every
+// run goes in a forked child process, and rss_kb is the rise of the peak
+// resident set size of that child over the run, so it holds the memory of
+// the allocator of the row alone.
+//
+// Usage: tf_util_bench [--json] [--ops=N]
+// Output is CSV by default, one line per scenario and allocator.
+
+#include <util/FixedMemPool.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory_resource>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include <sys/wait.h>
+
+namespace {
+
+constexpr size_t OBJECT_SIZE = 64;
+constexpr size_t WINDOW = 256;
+constexpr size_t LIVE_SET = 4096;
+constexpr size_t BATCH = 32;
+constexpr size_t QUEUE_SIZE = 1024;
+
+struct Object
+{
+    char    data_[OBJECT_SIZE];
+};
+
+//-----------------------------------------------------------------------------
+// Allocators, all with the same alloc/free interface
+struct MallocAllocator
+{
+    static const char* name() { return "malloc"; }
+    void* alloc() { return ::malloc(OBJECT_SIZE); }
+    void free(void* p) { ::free(p); }
+};
+
+struct FixedMemPoolAllocator
+{
+    static const char* name() { return "FixedMemPool"; }
+    tf::FixedMemPool pool_ {OBJECT_SIZE, tf::MemPool::BUCKET_SIZE/OBJECT_SIZE};
+    void* alloc() { return pool_.alloc(); }
+    void free(void* p) { pool_.free(p); }
+};
+
+struct FixedPoolAllocator
+{
+    static const char* name() { return "FixedPool"; }
+    tf::FixedPool<Object> pool_ {tf::MemPool::BUCKET_SIZE/OBJECT_SIZE};
+    void* alloc() { return pool_.alloc(); }
+    void free(void* p) { pool_.free(static_cast<Object*>(p)); }
+};
+
+struct MemPoolAllocator
+{
+    static const char* name() { return "MemPool"; }
+    void* alloc() { return tf::MemPool::instance().alloc(OBJECT_SIZE); }
+    void free(void* p) { tf::MemPool::instance().free(p); }
+};
+
+struct PmrPoolAllocator
+{
+    static const char* name() { return "pmr_unsync_pool"; }
+    std::pmr::unsynchronized_pool_resource pool_;
+    void* alloc() { return pool_.allocate(OBJECT_SIZE); }
+    void free(void* p) { pool_.deallocate(p, OBJECT_SIZE); }
+};
+
+// Allocators that can be freed to from another thread
+struct ConcurrentPoolAllocator
+{
+    static const char* name() { return "ConcurrentFixedMemPool"; }
+    tf::ConcurrentFixedMemPool pool_ {OBJECT_SIZE, tf::MemPool::BUCKET_SIZE/OBJECT_SIZE};
+    void* alloc() { return pool_.alloc(); }
+    void free(void* p) { pool_.free(p); }
+};
+
+struct OwnedPoolAllocator
+{
+    static const char* name() { return "OwnedFixedMemPool"; }
+    tf::OwnedFixedMemPool pool_ {OBJECT_SIZE, tf::MemPool::BUCKET_SIZE/OBJECT_SIZE};
+    void* alloc() { return pool_.alloc(); }
+    void free(void* p) { pool_.free(p); }
+};
+
+struct PmrSyncPoolAllocator
+{
+    static const char* name() { return "pmr_sync_pool"; }
+    std::pmr::synchronized_pool_resource pool_;
+    void* alloc() { return pool_.allocate(OBJECT_SIZE); }
+    void free(void* p) { pool_.deallocate(p, OBJECT_SIZE); }
+};
+
+//-----------------------------------------------------------------------------
+struct Result
+{
+    const char* scenario_;
+    const char* allocator_;
+    size_t      ops_;
+    double      ns_per_op_;
+    double      p99_ns_;
+    size_t      rss_kb_;
+};
+
+/// Returns a kB field of /proc/self/status, such as VmRSS or VmHWM
+size_t statusKB(const char* field)
+{
+    size_t kb = 0;
+    size_t len = std::strlen(field);
+    char line[256];
+    if (FILE* f = std::fopen("/proc/self/status", "r"))
+    {
+        while (std::fgets(line, sizeof(line), f))
+        {
+            if (std::strncmp(line, field, len) == 0 && line[len] == ':')
+            {
+                kb = std::strtoull(line+len+1, nullptr, 10);
+                break;
+            }
+        }
+        std::fclose(f);
+    }
+    return kb;
+}
+
+/// Times ops in batches of BATCH and keeps the per operation cost of each
+class Timer
+{
+  public:
+    explicit Timer(size_t ops) { samples_.reserve(ops/BATCH+1); }
+
+    void start()
+    {
+        start_ = batch_start_ = std::chrono::steady_clock::now();
+        count_ = 0;
+    }
+
+    TF_INLINE void tick()
+    {
+        if (++count_ % BATCH == 0)
+        {
+            auto now = std::chrono::steady_clock::now();
+            samples_.push_back(
+                std::chrono::duration<double, std::nano>(now-batch_start_).count()/BATCH);
+            batch_start_ = now;
+        }
+    }
+
+    Result result(const char* scenario, const char* allocator)
+    {
+        auto end = std::chrono::steady_clock::now();
+        double ns = std::chrono::duration<double, std::nano>(end-start_).count();
+        double p99 = 0;
+        if (!samples_.empty())
+        {
+            auto nth = samples_.begin() + samples_.size()*99/100;
+            std::nth_element(samples_.begin(), nth, samples_.end());
+            p99 = *nth;
+        }
+        return Result {scenario, allocator, count_, ns/count_, p99, 0};
+    }
+
+  private:
+    std::chrono::steady_clock::time_point   start_;
+    std::chrono::steady_clock::time_point   batch_start_;
+    size_t                                  count_ {0};
+    std::vector<double>                     samples_;
+};
+
+template <class Allocator>
+Result runLifo(size_t ops)
+{
+    Allocator allocator;
+    void* window[WINDOW];
+    Timer timer(ops);
+    timer.start();
+    for (size_t round=0; round<ops/(WINDOW*2); ++round)
+    {
+        for (size_t i=0; i<WINDOW; ++i)
+        {
+            window[i] = allocator.alloc();
+            timer.tick();
+        }
+        for (size_t i=WINDOW; i>0; --i)
+        {
+            allocator.free(window[i-1]);
+            timer.tick();
+        }
+    }
+    return timer.result("lifo", Allocator::name());
+}
+
+template <class Allocator>
+Result runFifo(size_t ops)
+{
+    Allocator allocator;
+    void* window[WINDOW];
+    Timer timer(ops);
+    timer.start();
+    for (size_t round=0; round<ops/(WINDOW*2); ++round)
+    {
+        for (size_t i=0; i<WINDOW; ++i)
+        {
+            window[i] = allocator.alloc();
+            timer.tick();
+        }
+        for (size_t i=0; i<WINDOW; ++i)
+        {
+            allocator.free(window[i]);
+            timer.tick();
+        }
+    }
+    return timer.result("fifo", Allocator::name());
+}
+
+template <class Allocator>
+Result runRandom(size_t ops)
+{
+    Allocator allocator;
+    std::vector<void*> live(LIVE_SET, nullptr);
+    // The slot sequence is generated up front so that every allocator
+    // sees the same lifetimes
+    std::vector<uint32_t> slots(ops);
+    uint64_t x = 88172645463325252ULL;
+    for (auto& slot: slots)
+    {
+        x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+        slot = uint32_t(x % LIVE_SET);
+    }
+    Timer timer(ops);
+    timer.start();
+    for (uint32_t slot: slots)
+    {
+        if (live[slot])
+        {
+            allocator.free(live[slot]);
+            live[slot] = nullptr;
+        }
+        else
+        {
+            live[slot] = allocator.alloc();
+        }
+        timer.tick();
+    }
+    Result result = timer.result("random", Allocator::name());
+    for (void* p: live)
+    {
+        if (p) allocator.free(p);
+    }
+    return result;
+}
+
+/// Single producer single consumer ring passing allocated objects
+class Channel
+{
+  public:
+    bool push(void* p)
+    {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail - head_.load(std::memory_order_acquire) == QUEUE_SIZE) return false;
+        slots_[tail % QUEUE_SIZE] = p;
+        tail_.store(tail+1, std::memory_order_release);
+        return true;
+    }
+
+    void* pop()
+    {
+        size_t head = head_.load(std::memory_order_relaxed);
+        if (head == tail_.load(std::memory_order_acquire)) return nullptr;
+        void* p = slots_[head % QUEUE_SIZE];
+        head_.store(head+1, std::memory_order_release);
+        return p;
+    }
+
+  private:
+    alignas(64) std::atomic<size_t>     head_ {0};
+    alignas(64) std::atomic<size_t>     tail_ {0};
+    void*                               slots_[QUEUE_SIZE];
+};
+
+template <class Allocator>
+Result runCrossThread(size_t ops)
+{
+    Allocator allocator;
+    Channel channel;
+    size_t num = ops/2;
+    std::thread consumer([&allocator, &channel, num]() {
+        for (size_t i=0; i<num; )
+        {
+            if (void* p = channel.pop())
+            {
+                allocator.free(p);
+                ++i;
+            }
+            else
+            {
+                std::this_thread::yield();
+            }
+        }
+    });
+    Timer timer(num);
+    timer.start();
+    for (size_t i=0; i<num; ++i)
+    {
+        void* p = allocator.alloc();
+        std::memset(p, 0, sizeof(void*));
+        while (!channel.push(p))
+        {
+            std::this_thread::yield();
+        }
+        timer.tick();
+    }
+    consumer.join();
+    // Both threads run an operation per object
+    Result result = timer.result("xthread", Allocator::name());
+    result.ops_ = num*2;
+    result.ns_per_op_ /= 2;
+    return result;
+}
+
+/// Runs a benchmark in a child process and sets the peak memory of the
+/// child over the run, which the memory of earlier runs never adds to
+Result runIsolated(Result (*run)(size_t), size_t ops)
+{
+    int fds[2];
+    if (::pipe(fds) != 0)
+    {
+        std::perror("pipe");
+        std::exit(1);
+    }
+    pid_t pid = ::fork();
+    if (pid == 0)
+    {
+        ::close(fds[0]);
+        // Resets VmHWM to the current resident set size
+        if (FILE* f = std::fopen("/proc/self/clear_refs", "w"))
+        {
+            std::fputs("5", f);
+            std::fclose(f);
+        }
+        size_t start_kb = statusKB("VmRSS");
+        Result result = run(ops);
+        size_t peak_kb = statusKB("VmHWM");
+        result.rss_kb_ = peak_kb > start_kb ? peak_kb - start_kb : 0;
+        bool sent = ::write(fds[1], &result, sizeof(result)) == ssize_t(sizeof(result));
+        ::_exit(sent ? 0 : 1);
+    }
+    ::close(fds[1]);
+    Result result {};
+    bool received = pid > 0 &&
+        ::read(fds[0], &result, sizeof(result)) == ssize_t(sizeof(result));
+    ::close(fds[0]);
+    int status = 0;
+    if (pid > 0)
+    {
+        ::waitpid(pid, &status, 0);
+    }
+    if (!received || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+    {
+        std::fprintf(stderr, "benchmark child process failed\n");
+        std::exit(1);
+    }
+    return result;
+}
+
+template <class Allocator>
+void runSingleThread(std::vector<Result>& results, size_t ops)
+{
+    results.push_back(runIsolated(&runLifo<Allocator>, ops));
+    results.push_back(runIsolated(&runFifo<Allocator>, ops));
+    results.push_back(runIsolated(&runRandom<Allocator>, ops));
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    bool json = false;
+    size_t ops = 4*1024*1024;
+    for (int i=1; i<argc; ++i)
+    {
+        if (std::strcmp(argv[i], "--json") == 0)
+        {
+            json = true;
+        }
+        else if (std::strncmp(argv[i], "--ops=", 6) == 0)
+        {
+            ops = std::strtoull(argv[i]+6, nullptr, 10);
+        }
+        else
+        {
+            std::fprintf(stderr, "Usage: %s [--json] [--ops=N]\n", argv[0]);
+            return 1;
+        }
+    }
+    ops = std::max(ops, WINDOW*2);
+
+    std::vector<Result> results;
+    runSingleThread<MallocAllocator>(results, ops);
+    runSingleThread<FixedMemPoolAllocator>(results, ops);
+    runSingleThread<FixedPoolAllocator>(results, ops);
+    runSingleThread<MemPoolAllocator>(results, ops);
+    runSingleThread<PmrPoolAllocator>(results, ops);
+    results.push_back(runIsolated(&runCrossThread<MallocAllocator>, ops));
+    results.push_back(runIsolated(&runCrossThread<ConcurrentPoolAllocator>, ops));
+    results.push_back(runIsolated(&runCrossThread<OwnedPoolAllocator>, ops));
+    results.push_back(runIsolated(&runCrossThread<PmrSyncPoolAllocator>, ops));
+
+    if (json)
+    {
+        std::printf("[\n");
+        for (size_t i=0; i<results.size(); ++i)
+        {
+            const Result& r = results[i];
+            std::printf("  {\"scenario\": \"%s\", \"allocator\": \"%s\", \"ops\": %zu, "
+                        "\"ns_per_op\": %.2f, \"p99_ns\": %.2f, \"rss_kb\": %zu}%s\n",
+                        r.scenario_, r.allocator_, r.ops_, r.ns_per_op_,
+                        r.p99_ns_, r.rss_kb_, i+1 < results.size() ? "," : "");
+        }
+        std::printf("]\n");
+    }
+    else
+    {
+        std::printf("scenario,allocator,ops,ns_per_op,p99_ns,rss_kb\n");
+        for (const Result& r: results)
+        {
+            std::printf("%s,%s,%zu,%.2f,%.2f,%zu\n", r.scenario_, r.allocator_,
+                        r.ops_, r.ns_per_op_, r.p99_ns_, r.rss_kb_);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,71 @@
+// Map heavy workload with the default allocator against MemPool adapters.
+// Each round inserts a window of order ids into a std::map keyed by id,
+// looks every one of them up and erases them in a shuffled order, which is
+// how the order book and RangeSet use their maps.
+
+#include <util/MemPoolResource.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <map>
+#include <random>
+#include <vector>
+
+namespace {
+
+constexpr size_t ROUNDS = 2000;
+constexpr size_t WINDOW = 1024;
+
+struct Order
+{
+    uint64_t    id_ {0};
+    double      price_ {0};
+    uint32_t    qty_ {0};
+};
+
+template <class Map>
+void runBench(const char* name, Map& orders, const std::vector<uint64_t>& ids)
+{
+    uint64_t checksum = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t round=0; round<ROUNDS; ++round)
+    {
+        uint64_t base = round*WINDOW;
+        for (size_t i=0; i<WINDOW; ++i)
+        {
+            orders.emplace(base+i, Order{base+i, 100.0, uint32_t(i)});
+        }
+        for (uint64_t id: ids)
+        {
+            checksum += orders.find(base+id)->second.qty_;
+        }
+        for (uint64_t id: ids)
+        {
+            orders.erase(base+id);
+        }
+    }
+    auto end = std::chrono::steady_clock::now();
+    double ns = std::chrono::duration<double, std::nano>(end-start).count();
+    std::printf("%-16s %8.2f ns/op (checksum %llu)\n", name,
+                ns/(ROUNDS*WINDOW*3), (unsigned long long)checksum);
+}
+
+} // namespace
+
+int main()
+{
+    std::vector<uint64_t> ids(WINDOW);
+    for (size_t i=0; i<WINDOW; ++i) ids[i] = i;
+    std::shuffle(ids.begin(), ids.end(), std::mt19937_64(42));
+
+    std::map<uint64_t, Order> std_orders;
+    runBench("std::allocator", std_orders, ids);
+
+    std::map<uint64_t, Order, std::less<uint64_t>,
+             tf::PoolAllocator<std::pair<const uint64_t, Order> > > pool_orders;
+    runBench("PoolAllocator", pool_orders, ids);
+
+    std::pmr::map<uint64_t, Order> pmr_orders(tf::MemPoolResource::defaultResource());
+    runBench("MemPoolResource", pmr_orders, ids);
+    return 0;
+}
@@ -0,0 +1,108 @@
+// Throughput benchmark of RingBuffer between two threads pinned to
+// separate cores. The producer writes messages of a given size, committing
+// every BATCH messages, and the consumer reads them back and commits its
+// reads per batch. Each size moves TOTAL bytes through a 1MB ring.
+//
+// Usage: RingBufferBench [producer_cpu consumer_cpu]
+// Output is CSV, one line per message size.
+
+#include <util/RingBuffer.h>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+#include <pthread.h>
+
+namespace {
+
+constexpr size_t RING_SIZE = 1024*1024;
+constexpr size_t TOTAL = size_t(8)*1024*1024*1024;
+constexpr size_t BATCH = 16;
+constexpr size_t SIZES[] = { 64, 256, 1024, 4096, 16384, 65536 };
+
+void pinThread(int cpu)
+{
+    if (cpu < 0)
+    {
+        return;
+    }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0)
+    {
+        std::fprintf(stderr, "Cannot pin to cpu %d\n", cpu);
+    }
+}
+
+double run(size_t msg_size, int producer_cpu, int consumer_cpu)
+{
+    tf::RingBuffer ring(RING_SIZE);
+    ring.init();
+    size_t num = TOTAL/msg_size;
+
+    std::thread consumer([&ring, msg_size, num, consumer_cpu]() {
+        pinThread(consumer_cpu);
+        std::vector<char> buf(msg_size);
+        for (size_t i=0; i<num; )
+        {
+            if (ring.read(buf.data(), msg_size))
+            {
+                if (++i % BATCH == 0) ring.commitRead();
+            }
+            else
+            {
+                ring.commitRead();
+                std::this_thread::yield();
+            }
+        }
+        ring.commitRead();
+    });
+
+    pinThread(producer_cpu);
+    std::vector<char> buf(msg_size, 'x');
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i=0; i<num; )
+    {
+        if (ring.write(buf.data(), msg_size))
+        {
+            if (++i % BATCH == 0) ring.commit();
+        }
+        else
+        {
+            ring.commit();
+            std::this_thread::yield();
+        }
+    }
+    ring.commit();
+    consumer.join();
+    double seconds = std::chrono::duration<double>(
+        std::chrono::steady_clock::now()-start).count();
+    return double(num*msg_size)/seconds/1e9;
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    int producer_cpu = -1;
+    int consumer_cpu = -1;
+    if (argc == 3)
+    {
+        producer_cpu = std::atoi(argv[1]);
+        consumer_cpu = std::atoi(argv[2]);
+    }
+    else if (argc != 1)
+    {
+        std::fprintf(stderr, "Usage: %s [producer_cpu consumer_cpu]\n", argv[0]);
+        return 1;
+    }
+
+    std::printf("msg_size,gb_per_sec\n");
+    for (size_t size: SIZES)
+    {
+        std::printf("%zu,%.2f\n", size, run(size, producer_cpu, consumer_cpu));
+    }
+    return 0;
+}
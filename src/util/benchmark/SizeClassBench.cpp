@@ -0,0 +1,79 @@
+// Memory footprint of MemPool size classes against power of two bins.
+// The object size distribution is read from a file given as the first
+// argument, one "size count" pair per line, e.g. taken from a heap profile
+// of the trading process.
+// Without an argument a built-in sample of message and order sizes is used.
+
+#include <util/FixedMemPool.h>
+#include <cstdio>
+#include <fstream>
+#include <utility>
+#include <vector>
+
+namespace {
+
+using SizeCount = std::pair<size_t, uint64_t>;
+
+// Sizes of the pooled market data messages, orders and book entries
+const std::vector<SizeCount> s_default_distribution = {
+    { 24, 200000 }, { 40, 150000 }, { 48, 300000 }, { 72, 120000 },
+    { 88, 80000 }, { 104, 60000 }, { 136, 250000 }, { 168, 90000 },
+    { 200, 40000 }, { 264, 30000 }, { 320, 20000 }, { 520, 10000 },
+    { 1100, 5000 }, { 2200, 2000 }, { 4200, 500 },
+};
+
+size_t pow2BinSize(size_t sz)
+{
+    size_t bin_size = 8;
+    while (bin_size < sz) bin_size <<= 1;
+    return bin_size;
+}
+
+void report(const char* name, uint64_t requested, uint64_t pooled)
+{
+    std::printf("%-16s requested=%12llu pooled=%12llu padding=%6.2f%%\n",
+                name, (unsigned long long)requested, (unsigned long long)pooled,
+                100.0*(pooled-requested)/pooled);
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    std::vector<SizeCount> distribution;
+    if (argc > 1)
+    {
+        std::ifstream in(argv[1]);
+        size_t size;
+        uint64_t count;
+        while (in >> size >> count)
+        {
+            if (size > 0 && size <= tf::MemPool::MAX_VALUE_SIZE)
+            {
+                distribution.emplace_back(size, count);
+            }
+        }
+    }
+    else
+    {
+        distribution = s_default_distribution;
+    }
+
+    // Each pooled entry also carries an 8 byte entry header
+    constexpr size_t HEADER_SIZE = 8;
+    uint64_t requested = 0;
+    uint64_t pow2_pooled = 0;
+    uint64_t class_pooled = 0;
+    for (const SizeCount& sc: distribution)
+    {
+        size_t class_size = tf::MemPool::binSize(tf::MemPool::sizeToBin(sc.first));
+        requested += sc.first*sc.second;
+        pow2_pooled += (pow2BinSize(sc.first)+HEADER_SIZE)*sc.second;
+        class_pooled += (class_size+HEADER_SIZE)*sc.second;
+        std::printf("size=%5zu count=%9llu pow2=%5zu class=%5zu\n", sc.first,
+                    (unsigned long long)sc.second, pow2BinSize(sc.first), class_size);
+    }
+    report("power of two", requested, pow2_pooled);
+    report("size classes", requested, class_pooled);
+    return 0;
+}
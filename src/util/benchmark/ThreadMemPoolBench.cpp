@@ -0,0 +1,95 @@
+// Contention benchmark of ThreadMemPool against glibc malloc/free.
+// Every thread runs rounds of allocating a window of mixed size objects
+// and releasing them, half of the releases in allocation order and half in
+// reverse order. Reported numbers are aggregated over all threads.
+
+#include <util/ThreadMemPool.h>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+namespace {
+
+constexpr size_t ROUNDS = 20000;
+constexpr size_t WINDOW = 64;
+constexpr size_t SIZES[] = { 24, 72, 136, 520 };
+constexpr size_t SIZE_NUM = sizeof(SIZES)/sizeof(SIZES[0]);
+
+struct MallocAllocator
+{
+    static const char* name() { return "malloc"; }
+    void* alloc(size_t sz) { return ::malloc(sz); }
+    void free(void* p) { ::free(p); }
+};
+
+struct ThreadMemPoolAllocator
+{
+    static const char* name() { return "ThreadMemPool"; }
+    void* alloc(size_t sz) { return tf::ThreadMemPool::instance().alloc(sz); }
+    void free(void* p) { tf::ThreadMemPool::instance().free(p); }
+};
+
+template <class Allocator>
+void runThread(std::atomic<bool>& start)
+{
+    Allocator allocator;
+    void* window[WINDOW];
+    while (!start.load(std::memory_order_acquire))
+    {
+        std::this_thread::yield();
+    }
+    for (size_t round=0; round<ROUNDS; ++round)
+    {
+        for (size_t i=0; i<WINDOW; ++i)
+        {
+            window[i] = allocator.alloc(SIZES[(round+i)%SIZE_NUM]);
+            *static_cast<volatile char*>(window[i]) = char(i);
+        }
+        if (round & 1)
+        {
+            for (size_t i=WINDOW; i>0; --i) allocator.free(window[i-1]);
+        }
+        else
+        {
+            for (size_t i=0; i<WINDOW; ++i) allocator.free(window[i]);
+        }
+    }
+}
+
+template <class Allocator>
+void runBench(size_t thread_num)
+{
+    std::atomic<bool> start {false};
+    std::vector<std::thread> threads;
+    for (size_t i=0; i<thread_num; ++i)
+    {
+        threads.emplace_back(runThread<Allocator>, std::ref(start));
+    }
+    auto t0 = std::chrono::steady_clock::now();
+    start.store(true, std::memory_order_release);
+    for (auto& thread: threads)
+    {
+        thread.join();
+    }
+    auto t1 = std::chrono::steady_clock::now();
+    double ns = std::chrono::duration<double, std::nano>(t1-t0).count();
+    double ops = double(thread_num) * ROUNDS * WINDOW * 2;
+    std::printf("%-14s threads=%-3zu %8.2f Mops/s %8.2f ns/op/thread\n",
+                Allocator::name(), thread_num,
+                ops / ns * 1000.0, ns * thread_num / ops);
+}
+
+} // namespace
+
+int main()
+{
+    for (size_t thread_num: { 1, 4, 16, 64 })
+    {
+        runBench<MallocAllocator>(thread_num);
+        runBench<ThreadMemPoolAllocator>(thread_num);
+    }
+    return 0;
+}
@@ -0,0 +1,274 @@
+#define CATCH_CONFIG_MAIN
+
+#include <util/SharedLog.h>
+#include <catch2/catch.hpp>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+/// Memory for a structure living in shared memory, cache line aligned
+struct Segment
+{
+    explicit Segment(size_t size): memory_(size + 64) {}
+    char* addr()
+    {
+        return reinterpret_cast<char*>(
+            tf::constAlign(reinterpret_cast<intptr_t>(memory_.data()), 64));
+    }
+    std::vector<char>   memory_;
+};
+} // namespace
+
+TEST_CASE( "SharedLog Variable Length Messages", "[SharedLog]" ) {
+    tf::SharedLog log(1024);
+    Segment segment(log.requiredSize());
+    log.init(segment.addr(), true);
+    tf::SharedLog::Reader reader(log);
+    REQUIRE(reader.peek().data() == nullptr);
+
+    // Records take their own size, 16 byte header plus padded payload
+    log.write("short", 5);
+    std::string longer(100, 'l');
+    log.write(longer.data(), longer.size());
+    REQUIRE(log.cursor() - reader.sequence() == 32 + 128);
+
+    char buf[256];
+    REQUIRE(reader.read(buf, sizeof(buf)) == 5);
+    REQUIRE(std::string(buf, 5) == "short");
+    std::string_view msg = reader.peek();
+    REQUIRE(msg == longer);
+    REQUIRE(reader.valid());
+    reader.consume();
+    REQUIRE(reader.read(buf, sizeof(buf)) == 0);
+
+    // A second process attaching to the log sees the same cursor
+    tf::SharedLog other(1024);
+    other.init(segment.addr(), false);
+    REQUIRE(other.cursor() == log.cursor());
+    tf::SharedLog mismatch(2048);
+    REQUIRE_THROWS(mismatch.init(segment.addr(), false));
+    REQUIRE_THROWS(log.write(buf, 250));
+}
+
+TEST_CASE( "SharedLog Reader Overrun", "[SharedLog]" ) {
+    tf::SharedLog log(1024);
+    Segment segment(log.requiredSize());
+    log.init(segment.addr(), true);
+    tf::SharedLog::Reader reader(log);
+
+    // The message is overwritten while the reader holds it
+    log.write("first", 5);
+    REQUIRE(reader.peek() == "first");
+    char data[100] = {};
+    for (size_t i=0; i<20; ++i) log.write(data, sizeof(data));
+    REQUIRE_FALSE(reader.valid());
+
+    // The reader skips to the newest message, wrapping over padding
+    REQUIRE(reader.peek().data() == nullptr);
+    REQUIRE(reader.overrunCount() == 1);
+    for (uint32_t i=0; i<50; ++i) log.write(reinterpret_cast<char*>(&i), sizeof(i));
+    REQUIRE(reader.overrunCount() == 1);
+    char buf[8];
+    REQUIRE(reader.read(buf, sizeof(buf)) == 0);
+    REQUIRE(reader.overrunCount() == 2);
+    uint32_t value = 50;
+    log.write(reinterpret_cast<char*>(&value), sizeof(value));
+    REQUIRE(reader.read(buf, sizeof(buf)) == sizeof(value));
+    REQUIRE(std::memcmp(buf, &value, sizeof(value)) == 0);
+}
+
+TEST_CASE( "SharedLog Multiple Producers", "[SharedLog]" ) {
+    // Large enough not to be overwritten, so that every message is read
+    constexpr uint32_t num = 10000;
+    tf::SharedLog log(4*1024*1024);
+    Segment segment(log.requiredSize());
+    log.init(segment.addr(), true);
+    tf::SharedLog::Reader reader(log);
+
+    std::vector<std::thread> producers;
+    for (uint32_t id=0; id<2; ++id)
+    {
+        producers.emplace_back([&log, id]{
+            for (uint32_t i=0; i<num; ++i)
+            {
+                // Messages of 8 to 260 bytes: id, sequence, filler
+                uint64_t sequence;
+                size_t len = 8 + 4*(i%64);
+                char* p = log.reserve(len, sequence);
+                std::memcpy(p, &id, 4);
+                std::memcpy(p+4, &i, 4);
+                std::memset(p+8, char(i), len-8);
+                log.publish(sequence);
+            }
+        });
+    }
+
+    uint32_t next[2] = {0, 0};
+    uint32_t bad = 0;
+    char buf[512];
+    while (next[0] < num || next[1] < num)
+    {
+        size_t len = reader.read(buf, sizeof(buf));
+        if (len == 0)
+        {
+            std::this_thread::yield();
+            continue;
+        }
+        uint32_t id, i;
+        std::memcpy(&id, buf, 4);
+        std::memcpy(&i, buf+4, 4);
+        // Messages of one producer come in order
+        bad += id > 1 || i != next[id] || len != 8 + 4*(i%64);
+        next[id & 1] = i+1;
+    }
+    for (auto& producer: producers) producer.join();
+    REQUIRE(bad == 0);
+    REQUIRE(reader.overrunCount() == 0);
+}
+
+TEST_CASE( "SharedLog Consumer Policies", "[SharedLog]" ) {
+    char data[100] = {};
+    char buf[128];
+    SECTION( "Overwrite" ) {
+        tf::SharedLog log(1024);
+        Segment segment(log.requiredSize());
+        log.init(segment.addr(), true);
+        tf::SharedLog::Reader reader(log, true);
+        REQUIRE(reader.consumerId() == 0);
+        REQUIRE(log.consumerLag(0) == 0);
+        REQUIRE(log.consumerLag(1) == -1);
+        log.write(data, sizeof(data));
+        REQUIRE(log.consumerLag(0) == 128);
+        REQUIRE(reader.read(buf, sizeof(buf)) == sizeof(data));
+        REQUIRE(log.consumerLag(0) == 0);
+        // Gating has no effect, the reader is overrun
+        for (size_t i=0; i<20; ++i) log.write(data, sizeof(data));
+        REQUIRE(reader.read(buf, sizeof(buf)) == 0);
+        REQUIRE(reader.overrunCount() == 1);
+    }
+    SECTION( "Evict" ) {
+        tf::SharedLog log(1024, tf::SL_Evict);
+        Segment segment(log.requiredSize());
+        log.init(segment.addr(), true);
+        tf::SharedLog::Reader gating(log, true);
+        tf::SharedLog::Reader monitor(log, false);
+        REQUIRE(monitor.consumerId() == 1);
+        log.write("first", 5);
+        REQUIRE(gating.peek() == "first");
+        for (size_t i=0; i<20; ++i) log.write(data, sizeof(data));
+        // The gating reader is evicted, the other one overrun
+        REQUIRE(gating.evicted());
+        REQUIRE_FALSE(gating.valid());
+        REQUIRE(gating.read(buf, sizeof(buf)) == 0);
+        REQUIRE(log.consumerLag(0) == -1);
+        REQUIRE(monitor.read(buf, sizeof(buf)) == 0);
+        REQUIRE_FALSE(monitor.evicted());
+        REQUIRE(monitor.overrunCount() == 1);
+    }
+    SECTION( "Registry Full" ) {
+        tf::SharedLog log(1024);
+        Segment segment(log.requiredSize());
+        log.init(segment.addr(), true);
+        std::vector<std::unique_ptr<tf::SharedLog::Reader>> readers;
+        for (size_t i=0; i<tf::SharedLog::MAX_CONSUMERS; ++i)
+        {
+            readers.emplace_back(new tf::SharedLog::Reader(log, false));
+        }
+        REQUIRE_THROWS(tf::SharedLog::Reader(log, false));
+        readers.pop_back();
+        tf::SharedLog::Reader reader(log, false);
+        REQUIRE(reader.consumerId() == int(tf::SharedLog::MAX_CONSUMERS-1));
+    }
+}
+
+TEST_CASE( "SharedLog Blocking Consumer", "[SharedLog]" ) {
+    // The producer laps the log many times, but waits for the reader
+    constexpr uint32_t num = 2000;
+    tf::SharedLog log(1024, tf::SL_Block);
+    Segment segment(log.requiredSize());
+    log.init(segment.addr(), true);
+    tf::SharedLog::Reader reader(log, true);
+
+    std::thread producer([&log]{
+        for (uint32_t i=0; i<num; ++i)
+        {
+            char data[64];
+            std::memset(data, char(i), sizeof(data));
+            std::memcpy(data, &i, sizeof(i));
+            log.write(data, 4 + 4*(i%16));
+        }
+    });
+
+    uint32_t bad = 0;
+    char buf[64];
+    for (uint32_t next=0; next<num; )
+    {
+        size_t len = reader.read(buf, sizeof(buf));
+        if (len == 0)
+        {
+            std::this_thread::yield();
+            continue;
+        }
+        uint32_t i;
+        std::memcpy(&i, buf, sizeof(i));
+        bad += i != next || len != 4 + 4*(i%16);
+        next = i+1;
+    }
+    producer.join();
+    REQUIRE(bad == 0);
+    REQUIRE(reader.overrunCount() == 0);
+    REQUIRE_FALSE(reader.evicted());
+}
+
+TEST_CASE( "SharedLog Sleeping Reader", "[SharedLog]" ) {
+    tf::SharedLog log(4096, tf::SL_Overwrite, true);
+    Segment segment(log.requiredSize());
+    log.init(segment.addr(), true);
+    tf::SharedLog::Reader reader(log);
+    tf::SharedLog polled(4096);
+    REQUIRE_THROWS(polled.init(segment.addr(), false));
+    Segment polled_segment(polled.requiredSize());
+    polled.init(polled_segment.addr(), true);
+    REQUIRE_THROWS(tf::SharedLog::Reader(polled).wait(0));
+    REQUIRE_FALSE(reader.wait(0));
+    REQUIRE_FALSE(reader.wait(10));
+
+    // The consumer sleeps between the bursts of the producer
+    constexpr uint32_t num = 100;
+    uint32_t received = 0;
+    std::thread consumer([&log, &received]{
+        tf::SharedLog::Reader reader(log, false);
+        char buf[8];
+        while (received < num && reader.wait(5000))
+        {
+            uint32_t value;
+            size_t len = reader.read(buf, sizeof(buf));
+            std::memcpy(&value, buf, sizeof(value));
+            if (len != sizeof(value) || value != received)
+            {
+                break;
+            }
+            ++received;
+        }
+    });
+    while (log.consumerLag(0) < 0)
+    {
+        std::this_thread::yield();
+    }
+    for (uint32_t i=0; i<num; ++i)
+    {
+        if (i % 10 == 0)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        }
+        log.write(reinterpret_cast<char*>(&i), sizeof(i));
+    }
+    consumer.join();
+    REQUIRE(received == num);
+    REQUIRE(reader.wait(0));
+}
@@ -0,0 +1,669 @@
+#define CATCH_CONFIG_MAIN
+
+#include <util/FixedMemPool.h>
+#include <util/ThreadMemPool.h>
+#include <util/MemPoolResource.h>
+#include <util/Arena.h>
+#include <util/PoolPtr.h>
+#include <util/SharedFixedMemPool.h>
+#include <util/EpochDomain.h>
+#include <util/SlotMap.h>
+#include <catch2/catch.hpp>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace {
+struct alignas(64) Quote
+{
+    uint64_t    id_;
+    double      prices_[7];
+};
+
+struct Message: tf::MemPoolNew
+{
+    uint64_t    seq_ {0};
+    char        payload_[200];
+};
+
+struct Order
+{
+    uint64_t    id_;
+    double      price_;
+    uint32_t    qty_;
+    Order(uint64_t id = 0, double price = 0, uint32_t qty = 0)
+      : id_(id), price_(price), qty_(qty) {}
+};
+} // namespace
+
+TEST_CASE( "MemPool Acquire Release", "[MemPool]" ) {
+    tf::MemPool& pool = tf::MemPool::instance();
+    Order* order = pool.acq<Order>(1, 100.5, 10);
+    REQUIRE(order->id_ == 1);
+    REQUIRE(order->qty_ == 10);
+    pool.del(order);
+    Order* reused = pool.acq<Order>(2, 101.0, 20);
+    REQUIRE(reused == order);
+    pool.del(reused);
+}
+
+TEST_CASE( "ThreadMemPool Reuse In Thread", "[ThreadMemPool]" ) {
+    tf::ThreadMemPool& pool = tf::ThreadMemPool::instance();
+    Order* order = pool.acq<Order>(1, 100.5, 10);
+    REQUIRE(order->price_ == 100.5);
+    pool.del(order);
+    Order* reused = pool.acq<Order>(2, 101.0, 20);
+    REQUIRE(reused == order);
+    pool.free(reused);
+}
+
+TEST_CASE( "ThreadMemPool Cross Thread Free", "[ThreadMemPool]" ) {
+    constexpr size_t num = tf::MagazineDepot::MAGAZINE_SIZE * 4;
+    std::vector<Order*> orders;
+    std::thread producer([&orders]{
+        for (size_t i=0; i<num; ++i)
+            orders.push_back(tf::ThreadMemPool::instance().acq<Order>(i, 1.0, 1));
+    });
+    producer.join();
+    for (size_t i=0; i<num; ++i) REQUIRE(orders[i]->id_ == i);
+
+    // Entries freed on this thread travel back through the depot
+    for (Order* order: orders) tf::ThreadMemPool::instance().del(order);
+    std::vector<Order*> reused;
+    std::thread consumer([&reused]{
+        for (size_t i=0; i<num; ++i)
+            reused.push_back(tf::ThreadMemPool::instance().acq<Order>(i, 2.0, 2));
+        for (Order* order: reused) tf::ThreadMemPool::instance().del(order);
+    });
+    consumer.join();
+    size_t num_reused = 0;
+    for (Order* order: reused)
+        if (std::find(orders.begin(), orders.end(), order) != orders.end()) ++num_reused;
+    REQUIRE(num_reused > 0);
+}
+
+TEST_CASE( "ConcurrentFixedPool Shared By Threads", "[ConcurrentFixedMemPool]" ) {
+    constexpr size_t thread_num = 4;
+    constexpr size_t num = 10000;
+    tf::ConcurrentFixedPool<Order> pool(64);
+    std::vector<std::vector<Order*>> allocated(thread_num);
+    std::vector<std::thread> threads;
+    for (size_t t=0; t<thread_num; ++t)
+    {
+        threads.emplace_back([&pool, &allocated, t]{
+            std::vector<Order*> live;
+            for (size_t i=0; i<num; ++i)
+            {
+                live.push_back(pool.alloc());
+                live.back()->id_ = t;
+                if (i % 3 == 2)
+                {
+                    pool.free(live[live.size()-2]);
+                    live.erase(live.end()-2);
+                }
+            }
+            allocated[t] = std::move(live);
+        });
+    }
+    for (auto& thread: threads) thread.join();
+
+    std::vector<Order*> all;
+    for (size_t t=0; t<thread_num; ++t)
+    {
+        for (Order* order: allocated[t])
+        {
+            REQUIRE(order->id_ == t);
+            all.push_back(order);
+        }
+    }
+    std::sort(all.begin(), all.end());
+    REQUIRE(std::adjacent_find(all.begin(), all.end()) == all.end());
+    for (Order* order: all) pool.free(order);
+}
+
+TEST_CASE( "FixedPool With Huge Page Buckets", "[BucketProvider]" ) {
+    tf::HugePageBucketProvider provider(true, true);
+    tf::FixedPool<Order> pool(1024, false, &provider);
+    Order* first = pool.alloc();
+    Order* second = pool.alloc();
+    REQUIRE(second != first);
+    pool.free(first);
+    REQUIRE(pool.alloc() == first);
+    pool.free(first);
+    pool.free(second);
+}
+
+TEST_CASE( "Huge Page Bucket Alignment", "[BucketProvider]" ) {
+    // Only a bucket aligned to huge pages holds whole huge pages
+    constexpr size_t HUGE_PAGE_SIZE = tf::HugePageBucketProvider::HUGE_PAGE_SIZE;
+    tf::HugePageBucketProvider transparent(false, true);
+    void* bucket = transparent.acquire(HUGE_PAGE_SIZE + 4096);
+    REQUIRE(reinterpret_cast<uintptr_t>(bucket) % HUGE_PAGE_SIZE == 0);
+    transparent.release(bucket, HUGE_PAGE_SIZE + 4096);
+
+    tf::NumaBucketProvider numa(0, false, true);
+    bucket = numa.acquire(4096);
+    REQUIRE(reinterpret_cast<uintptr_t>(bucket) % HUGE_PAGE_SIZE == 0);
+    numa.release(bucket, 4096);
+}
+
+TEST_CASE( "FixedPool Statistics", "[MemPoolStats]" ) {
+    tf::FixedPool<Order> pool(16);
+    Order* orders[20];
+    for (Order*& order: orders) order = pool.alloc();
+    for (size_t i=0; i<10; ++i) pool.free(orders[i]);
+    tf::PoolStats stats = pool.getStats();
+    REQUIRE(stats.value_size_ == sizeof(Order));
+    REQUIRE(stats.entry_size_ == sizeof(Order) + 8);
+#ifdef TF_MEMPOOL_STATS
+    REQUIRE(stats.allocs_ == 20);
+    REQUIRE(stats.frees_ == 10);
+    REQUIRE(stats.live_ == 10);
+    REQUIRE(stats.high_water_ == 20);
+    REQUIRE(stats.buckets_ == 2);
+    REQUIRE(stats.mapped_bytes_ == 2*16*stats.entry_size_);
+#endif
+    for (size_t i=10; i<20; ++i) pool.free(orders[i]);
+}
+
+TEST_CASE( "MemPool Size Classes", "[MemPool]" ) {
+    using tf::MemPool;
+    static_assert(MemPool::POOL_NUMBER == 36);
+    static_assert(MemPool::binSize(MemPool::binIndex(136)) == 160);
+    static_assert(MemPool::binSize(MemPool::POOL_NUMBER-1) == MemPool::MAX_VALUE_SIZE);
+    for (size_t sz=1; sz<=MemPool::MAX_VALUE_SIZE; ++sz)
+    {
+        uint32_t bin = MemPool::binIndex(sz);
+        REQUIRE(MemPool::sizeToBin(sz) == bin);
+        REQUIRE(MemPool::binSize(bin) >= sz);
+        REQUIRE((bin == 0 || MemPool::binSize(bin-1) < sz));
+    }
+}
+
+TEST_CASE( "OwnedFixedPool Remote Free", "[OwnedFixedMemPool]" ) {
+    constexpr size_t num = 100;
+    tf::OwnedFixedPool<Order> pool(num);
+    std::vector<Order*> orders;
+    for (size_t i=0; i<num; ++i) orders.push_back(pool.alloc());
+
+    // The consumer thread frees through the registry without the pool
+    std::thread consumer([&orders]{
+        for (Order* order: orders) tf::OwnedFixedPool<Order>::release(order);
+    });
+    consumer.join();
+
+    // The first bucket is used up, so the next allocations drain the
+    // return list instead of creating a new bucket
+    for (size_t i=0; i<num; ++i)
+    {
+        Order* order = pool.alloc();
+        REQUIRE(std::find(orders.begin(), orders.end(), order) != orders.end());
+    }
+}
+
+TEST_CASE( "FixedPool Trim Idle Buckets", "[FixedMemPool]" ) {
+    constexpr size_t bucket_entry_num = 16;
+    constexpr size_t bucket_size = bucket_entry_num * (sizeof(Order) + 8);
+    tf::FixedPool<Order> pool(bucket_entry_num);
+    std::vector<Order*> orders;
+    for (size_t i=0; i<bucket_entry_num*4; ++i) orders.push_back(pool.alloc());
+
+    // One live entry keeps the first bucket
+    for (size_t i=1; i<orders.size(); ++i) pool.free(orders[i]);
+    REQUIRE(pool.trim() == 3*bucket_size);
+    REQUIRE(pool.trim() == 0);
+
+    // Discarded buckets are reused before new ones are mapped
+    orders.resize(1);
+    for (size_t i=1; i<bucket_entry_num*2; ++i) orders.push_back(pool.alloc());
+    for (size_t i=1; i<orders.size(); ++i) pool.free(orders[i]);
+    REQUIRE(pool.trim(tf::TS_DontNeed) == bucket_size);
+    Order* order = pool.alloc();
+    order->id_ = 7;
+    pool.free(order);
+
+    // Automatic trim once more than a bucket of entries is free
+    pool.setTrimThreshold(bucket_entry_num);
+    orders.resize(1);
+    for (size_t i=1; i<bucket_entry_num*3; ++i) orders.push_back(pool.alloc());
+    for (size_t i=1; i<orders.size(); ++i) pool.free(orders[i]);
+    pool.free(orders[0]);
+    // One bucket was released on the way, the rest stays under the trigger
+    REQUIRE(pool.trim() == 2*bucket_size);
+}
+
+TEST_CASE( "FixedPool Discard Locked Buckets", "[FixedMemPool]" ) {
+    struct alignas(4096) Page { char data_[4096]; };
+    tf::FixedPool<Page> pool(4);
+    std::vector<Page*> pages;
+    for (size_t i=0; i<8; ++i) pages.push_back(pool.alloc());
+    for (size_t i=1; i<pages.size(); ++i) pool.free(pages[i]);
+    try
+    {
+        pool.prefault(true);
+    }
+    catch (const std::runtime_error&)
+    {
+        // Over the memory lock limit of the process
+        pool.free(pages[0]);
+        return;
+    }
+
+    // The second bucket is idle, its pages are dropped even though it was
+    // locked
+    REQUIRE(pool.trim(tf::TS_DontNeed) > 0);
+    unsigned char resident = 1;
+    REQUIRE(::mincore(pages[5], 4096, &resident) == 0);
+    REQUIRE((resident & 1) == 0);
+    pool.free(pages[0]);
+}
+
+TEST_CASE( "MemPool Allocator Adapters", "[MemPool]" ) {
+    std::map<uint64_t, Order, std::less<uint64_t>,
+             tf::PoolAllocator<std::pair<const uint64_t, Order> > > orders;
+    for (uint64_t i=0; i<1000; ++i) orders.emplace(i, Order(i));
+    REQUIRE(orders.size() == 1000);
+    REQUIRE(orders[500].id_ == 500);
+    orders.clear();
+
+    tf::MemPoolResource resource;
+    std::pmr::vector<Order> small(&resource);
+    small.resize(4);
+    REQUIRE(tf::MemPool::instance().entryBin(small.data()) ==
+            tf::MemPool::sizeToBin(4*sizeof(Order)));
+    // Above MAX_VALUE_SIZE the upstream resource is used
+    std::pmr::vector<Order> large(&resource);
+    large.resize(tf::MemPool::MAX_VALUE_SIZE/sizeof(Order)+1);
+    large.back().id_ = 1;
+    REQUIRE(resource.is_equal(*tf::MemPoolResource::defaultResource()));
+}
+
+TEST_CASE( "Arena Reset And Rewind", "[Arena]" ) {
+    constexpr size_t block_size = 1024;
+    tf::Arena arena(block_size);
+    Order* first = arena.acq<Order>(1, 100.5, 10);
+    REQUIRE(reinterpret_cast<uintptr_t>(first) % alignof(Order) == 0);
+    {
+        tf::Arena::Scope scope(arena);
+        for (size_t i=0; i<100; ++i) arena.acq<Order>(i);
+        REQUIRE(arena.capacity() > block_size);
+    }
+    // Memory after the scope marker is reused
+    Order* second = arena.acq<Order>(2);
+    REQUIRE(second == first+1);
+
+    // Blocks are kept across resets, including oversized ones
+    size_t capacity = 0;
+    for (size_t round=0; round<2; ++round)
+    {
+        arena.reset();
+        REQUIRE(arena.acq<Order>() == first);
+        for (size_t i=0; i<100; ++i) arena.acq<Order>(i);
+        arena.alloc(block_size*4);
+        if (round == 0) capacity = arena.capacity();
+    }
+    REQUIRE(arena.capacity() == capacity);
+
+    tf::ArenaResource resource(arena);
+    std::pmr::vector<Order> orders(&resource);
+    for (uint64_t i=0; i<1000; ++i) orders.emplace_back(i);
+    REQUIRE(orders[999].id_ == 999);
+}
+
+TEST_CASE( "PoolPtr Shared Entries", "[PoolPtr]" ) {
+    // Headerless MemPool entries have no reference count
+#ifndef TF_MEMPOOL_HEADERLESS
+    tf::PoolPtr<Order> order = tf::makePoolPtr<Order>(1, 100.5, 10);
+    REQUIRE(order.useCount() == 1);
+    {
+        std::vector<tf::PoolPtr<Order> > consumers(8, order);
+        REQUIRE(order.useCount() == 9);
+    }
+    REQUIRE(order.useCount() == 1);
+    Order* p = order.get();
+    order.reset();
+    REQUIRE(!order);
+    REQUIRE(tf::MemPool::instance().acq<Order>() == p);
+    tf::MemPool::instance().del(p);
+#endif
+
+    // The last consumer frees the message, whichever thread it runs on
+    tf::ConcurrentFixedMemPool pool(sizeof(Order));
+    std::atomic<uint64_t> received {0};
+    for (size_t round=0; round<100; ++round)
+    {
+        auto message = tf::PoolPtr<Order, tf::ConcurrentFixedMemPool>::make(&pool, round);
+        std::vector<std::thread> threads;
+        for (size_t i=0; i<4; ++i)
+        {
+            threads.emplace_back([message, &received]() mutable {
+                received += message->id_;
+                message.reset();
+            });
+        }
+        message.reset();
+        for (auto& thread: threads) thread.join();
+    }
+    REQUIRE(received == 4*99*100/2);
+    void* entry = pool.alloc();
+    REQUIRE(*tf::FixedMemPool::refCount(entry) == 1);
+    pool.free(entry);
+
+    // Headerless entries have no room for the count
+    tf::FixedMemPool headerless_pool(sizeof(Order), 100, true, nullptr, 8, true);
+    if (headerless_pool.isHeaderless())
+    {
+        REQUIRE_THROWS(tf::PoolPtr<Order, tf::FixedMemPool>::make(&headerless_pool, 1));
+    }
+}
+
+TEST_CASE( "SharedFixedMemPool Mapped Twice", "[SharedFixedMemPool]" ) {
+    constexpr size_t entry_num = 1000;
+    tf::SharedFixedMemPool writer(sizeof(Order), entry_num, 64);
+    tf::SharedFixedMemPool reader(sizeof(Order), entry_num, 64);
+
+    // Two mappings of one segment at different addresses
+    int fd = ::memfd_create("SharedFixedMemPoolTest", 0);
+    REQUIRE(fd >= 0);
+    REQUIRE(::ftruncate(fd, writer.requiredSize()) == 0);
+    char* writer_addr = static_cast<char*>(::mmap(nullptr, writer.requiredSize(),
+        PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0));
+    char* reader_addr = static_cast<char*>(::mmap(nullptr, reader.requiredSize(),
+        PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0));
+    ::close(fd);
+    REQUIRE(writer_addr != reader_addr);
+    writer.init(writer_addr, true);
+    reader.init(reader_addr, false);
+
+    Order* order = new(writer.alloc()) Order(1, 100.5, 10);
+    uint32_t offset = writer.toOffset(order);
+    Order* received = static_cast<Order*>(reader.fromOffset(offset));
+    REQUIRE(received->price_ == 100.5);
+    reader.free(received);
+    REQUIRE(writer.alloc() == order);
+    writer.free(order);
+
+    // Entries freed by either side are shared, up to the segment size
+    std::vector<std::thread> threads;
+    for (tf::SharedFixedMemPool* pool: {&writer, &reader})
+    {
+        threads.emplace_back([pool]() {
+            std::vector<void*> entries;
+            for (size_t round=0; round<1000; ++round)
+            {
+                for (size_t i=0; i<entry_num/4; ++i) entries.push_back(pool->alloc());
+                for (void* p: entries) pool->free(p);
+                entries.clear();
+            }
+        });
+    }
+    for (auto& thread: threads) thread.join();
+    std::vector<void*> entries;
+    while (void* p = reader.alloc()) entries.push_back(p);
+    REQUIRE(entries.size() == entry_num);
+    tf::SharedFixedMemPool other(sizeof(Order), entry_num+1);
+    REQUIRE_THROWS(other.init(writer_addr, false));
+
+    ::munmap(writer_addr, writer.requiredSize());
+    ::munmap(reader_addr, reader.requiredSize());
+}
+
+TEST_CASE( "FixedPool Reserve And Prefault", "[FixedMemPool]" ) {
+    tf::FixedPool<Order> pool(16);
+    pool.reserve(100);
+    pool.prefault();
+    pool.sortFreeList();
+
+    // The reserved entries are handed out in address order
+    std::vector<Order*> orders;
+    for (size_t i=0; i<100; ++i) orders.push_back(pool.alloc());
+    REQUIRE(std::is_sorted(orders.begin(), orders.end()));
+#ifdef TF_MEMPOOL_STATS
+    REQUIRE(pool.getStats().buckets_ == 7);
+#endif
+    for (Order* order: orders) pool.free(order);
+}
+
+TEST_CASE( "FixedPool Batch Alloc Free", "[FixedMemPool]" ) {
+    constexpr size_t num = 250;
+    tf::FixedPool<Order> pool(100);
+    Order* orders[num];
+    Order* single = pool.alloc();
+    pool.allocN(orders, num);
+    std::vector<Order*> sorted(orders, orders+num);
+    sorted.push_back(single);
+    std::sort(sorted.begin(), sorted.end());
+    REQUIRE(std::adjacent_find(sorted.begin(), sorted.end()) == sorted.end());
+    pool.free(single);
+    pool.freeN(orders, num);
+
+    // Freed as one segment, the batch comes back in the same order
+    Order* again[num];
+    pool.allocN(again, num);
+    REQUIRE(std::equal(orders, orders+num, again));
+    pool.freeN(again, num);
+
+    tf::MemPool& mem_pool = tf::MemPool::instance();
+    mem_pool.acqN(orders, num, 7, 100.5, 10);
+    REQUIRE(orders[num-1]->id_ == 7);
+    REQUIRE(tf::MemPool::instance().entryBin(orders[0]) == tf::MemPool::sizeToBin(sizeof(Order)));
+    mem_pool.delN(orders, num);
+}
+
+namespace {
+/// Fails once the given number of buckets has been made
+class LimitedBucketProvider: public tf::MallocBucketProvider
+{
+  public:
+    size_t  bucket_left_ {0};
+    size_t  released_ {0};
+
+  protected:
+    void* allocBucket(size_t size, size_t alignment) override
+    {
+        if (bucket_left_ == 0)
+        {
+            throw std::runtime_error("no bucket left");
+        }
+        --bucket_left_;
+        return MallocBucketProvider::allocBucket(size, alignment);
+    }
+    void freeBucket(void* bucket, size_t size) override
+    {
+        ++released_;
+        MallocBucketProvider::freeBucket(bucket, size);
+    }
+};
+} // namespace
+
+TEST_CASE( "FixedPool Batch Alloc Out Of Memory", "[FixedMemPool]" ) {
+    LimitedBucketProvider provider;
+    provider.bucket_left_ = 2;
+    tf::FixedPool<Order> pool(10, true, &provider);
+    Order* orders[40];
+    pool.allocN(orders, 5);
+
+    // The second of the two buckets needed fails, the first is given back
+    // and the free list is left as it was
+    REQUIRE_THROWS(pool.allocN(orders+5, 25));
+    REQUIRE(provider.released_ == 1);
+    pool.allocN(orders+5, 5);
+    provider.bucket_left_ = 3;
+    pool.allocN(orders+10, 30);
+    std::vector<Order*> sorted(orders, orders+40);
+    std::sort(sorted.begin(), sorted.end());
+    REQUIRE(std::adjacent_find(sorted.begin(), sorted.end()) == sorted.end());
+    pool.freeN(orders, 40);
+}
+
+TEST_CASE( "FixedPool Aligned Entries", "[FixedMemPool]" ) {
+    tf::FixedPool<Quote> pool(10);
+    tf::FixedPool<Quote, 64, true> headerless_pool(10);
+    tf::FixedPool<Order, 32> order_pool(10);
+    std::vector<Quote*> quotes;
+    for (size_t i=0; i<25; ++i)
+    {
+        quotes.push_back(pool.alloc());
+        quotes.push_back(headerless_pool.alloc());
+        Order* order = order_pool.alloc();
+        REQUIRE(reinterpret_cast<uintptr_t>(order) % 32 == 0);
+        order->id_ = i;
+    }
+    for (Quote* quote: quotes)
+    {
+        REQUIRE(reinterpret_cast<uintptr_t>(quote) % 64 == 0);
+        quote->prices_[6] = 1.0;
+    }
+    REQUIRE(pool.getStats().entry_size_ == 128);
+#ifdef NDEBUG
+    REQUIRE(headerless_pool.getStats().entry_size_ == 64);
+#endif
+    for (size_t i=0; i<quotes.size(); i+=2)
+    {
+        pool.free(quotes[i]);
+        headerless_pool.free(quotes[i+1]);
+    }
+    REQUIRE(headerless_pool.trim() > 0);
+}
+
+TEST_CASE( "MemPool Page Map Lookup", "[MemPool]" ) {
+    tf::MemPool& pool = tf::MemPool::instance();
+    std::vector<Message*> messages;
+    for (uint64_t i=0; i<1000; ++i)
+    {
+        messages.push_back(new Message);
+        messages.back()->seq_ = i;
+    }
+    for (Message* message: messages)
+    {
+        REQUIRE(pool.entryBin(message) == tf::MemPool::sizeToBin(sizeof(Message)));
+        delete message;
+    }
+    for (size_t size: {1, 100, 1000, 8192})
+    {
+        void* p = pool.alloc(size);
+        REQUIRE(pool.entryBin(p) == tf::MemPool::sizeToBin(size));
+        pool.free(p);
+    }
+    Order order;
+    REQUIRE_THROWS(pool.free(&order));
+}
+
+TEST_CASE( "EpochDomain Retire To Pool", "[EpochDomain]" ) {
+    struct Node
+    {
+        uint64_t    first_;
+        uint64_t    second_;
+    };
+    constexpr size_t num = 20000;
+    tf::FixedPool<Node> pool(256);
+    tf::EpochDomain& domain = tf::EpochDomain::instance();
+    std::atomic<Node*> current {new(pool.alloc())Node {0, 0}};
+    std::atomic<bool> stop {false};
+    std::atomic<size_t> torn {0};
+    std::vector<Node*> nodes {current.load()};
+
+    // Readers never see a node that went back to the pool
+    std::vector<std::thread> readers;
+    for (size_t i=0; i<2; ++i)
+    {
+        readers.emplace_back([&]{
+            while (!stop.load(std::memory_order_relaxed))
+            {
+                tf::EpochGuard guard(domain);
+                Node* node = current.load(std::memory_order_acquire);
+                if (node->first_ != node->second_) ++torn;
+            }
+        });
+    }
+    for (size_t i=1; i<=num; ++i)
+    {
+        Node* node = new(pool.alloc())Node {i, i};
+        nodes.push_back(node);
+        domain.retire(current.exchange(node, std::memory_order_acq_rel), &pool);
+        if (i % 1000 == 0) std::this_thread::yield();
+    }
+    stop = true;
+    for (auto& reader: readers) reader.join();
+    REQUIRE(torn == 0);
+
+    // Every retired entry is back in the pool after synchronize
+    domain.synchronize();
+    std::sort(nodes.begin(), nodes.end());
+    nodes.erase(std::unique(nodes.begin(), nodes.end()), nodes.end());
+    std::vector<Node*> reused;
+    for (size_t i=1; i<nodes.size(); ++i) reused.push_back(pool.alloc());
+    std::sort(reused.begin(), reused.end());
+    REQUIRE(std::includes(nodes.begin(), nodes.end(), reused.begin(), reused.end()));
+    for (Node* node: reused) pool.free(node);
+    pool.free(current.load());
+}
+
+TEST_CASE( "SlotMap Stale Handles", "[SlotMap]" ) {
+    tf::SlotMap<Order> orders;
+    std::vector<tf::SlotMap<Order>::Handle> handles;
+    for (uint64_t i=0; i<10; ++i) handles.push_back(orders.emplace(i, 1.5, 100));
+    REQUIRE(orders.get(tf::SlotMap<Order>::NULL_HANDLE) == nullptr);
+
+    // Erase swaps the last order into the hole, handles keep working
+    REQUIRE(orders.erase(handles[2]));
+    REQUIRE_FALSE(orders.erase(handles[2]));
+    REQUIRE(orders.get(handles[2]) == nullptr);
+    REQUIRE(orders.size() == 9);
+    REQUIRE(orders.get(handles[9])->id_ == 9);
+    REQUIRE(orders.begin()[2].id_ == 9);
+
+    // The slot is reused with a new generation
+    auto handle = orders.emplace(42);
+    REQUIRE(handle != handles[2]);
+    REQUIRE(orders.get(handles[2]) == nullptr);
+    REQUIRE(orders.get(handle)->id_ == 42);
+
+    uint64_t sum = 0;
+    for (const Order& order: orders) sum += order.id_;
+    REQUIRE(sum == 45 - 2 + 42);
+    for (size_t pos=0; pos<orders.size(); ++pos)
+    {
+        REQUIRE(orders.get(orders.handleAt(pos)) == &orders.begin()[pos]);
+    }
+    orders.clear();
+    REQUIRE(orders.empty());
+    REQUIRE_FALSE(orders.contains(handle));
+}
+
+TEST_CASE( "SlotMap Throwing Emplace", "[SlotMap]" ) {
+    struct Picky
+    {
+        explicit Picky(int value): value_(value)
+        {
+            if (value < 0) throw std::runtime_error("Picky: negative");
+        }
+        int value_;
+    };
+    using Map = tf::SlotMap<Picky>;
+    Map map;
+    REQUIRE_THROWS_AS(map.emplace(-1), std::runtime_error);
+    REQUIRE(map.empty());
+    // The slot left free has the generation of the handle it would get
+    Map::Handle first = (Map::Handle(1) << 32) | 0;
+    REQUIRE(map.get(first) == nullptr);
+    REQUIRE_FALSE(map.contains(first));
+    REQUIRE_FALSE(map.erase(first));
+
+    Map::Handle handle = map.emplace(7);
+    REQUIRE(handle == first);
+    REQUIRE(map.get(handle)->value_ == 7);
+    // A free slot chained to another free slot holds no value either
+    Map::Handle other = map.emplace(8);
+    REQUIRE(map.erase(other));
+    REQUIRE(map.erase(handle));
+    REQUIRE_THROWS_AS(map.emplace(-1), std::runtime_error);
+    REQUIRE(map.get((Map::Handle(2) << 32) | 0) == nullptr);
+    REQUIRE(map.get((Map::Handle(2) << 32) | 1) == nullptr);
+    REQUIRE(map.empty());
+}
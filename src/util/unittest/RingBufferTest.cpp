@@ -0,0 +1,297 @@
+#define CATCH_CONFIG_MAIN
+
+#include <util/RingBuffer.h>
+#include <catch2/catch.hpp>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <fcntl.h>
+#include <unistd.h>
+#include <vector>
+
+TEST_CASE( "RingBuffer Batched Commit", "[RingBuffer]" ) {
+    tf::RingBuffer ring(100);
+    ring.init();
+    REQUIRE(ring.capacity() == 128);
+
+    // Staged writes are not visible before commit
+    REQUIRE(ring.write("hello", 5));
+    REQUIRE(ring.write(" world", 6));
+    REQUIRE(ring.empty());
+    ring.commit();
+    REQUIRE(ring.size() == 11);
+
+    char buf[128];
+    REQUIRE_FALSE(ring.read(buf, 12));
+    REQUIRE(ring.read(buf, 11));
+    REQUIRE(std::string(buf, 11) == "hello world");
+
+    // The space comes back to the writer on commitRead
+    std::string block(120, 'x');
+    REQUIRE_FALSE(ring.write(block.data(), block.size()));
+    ring.commitRead();
+    REQUIRE(ring.write(block.data(), block.size()));
+    ring.commit();
+
+    // The block wraps, fetch returns it in two pieces
+    struct iovec iov[2];
+    REQUIRE(ring.fetch(iov) == 120);
+    REQUIRE(iov[0].iov_len == 128-11);
+    REQUIRE(iov[1].iov_len == 3);
+    ring.skip(120);
+    ring.commitRead();
+    REQUIRE(ring.freeSpace() == 128);
+}
+
+TEST_CASE( "RingBuffer Attach Existing", "[RingBuffer]" ) {
+    tf::RingBuffer producer(64);
+    std::vector<char> memory(producer.requiredSize() + 64);
+    char* addr = reinterpret_cast<char*>(
+        tf::constAlign(reinterpret_cast<intptr_t>(memory.data()), 64));
+    producer.init(addr, true);
+    REQUIRE(producer.write("abc", 3));
+    producer.commit();
+
+    // A second ring on the same memory, as in another process
+    tf::RingBuffer consumer(64);
+    consumer.init(addr, false);
+    char buf[3];
+    REQUIRE(consumer.read(buf, 3));
+    REQUIRE(std::string(buf, 3) == "abc");
+
+    tf::RingBuffer other(128);
+    REQUIRE_THROWS(other.init(addr, false));
+}
+
+TEST_CASE( "RingBuffer Producer Consumer Threads", "[RingBuffer]" ) {
+    constexpr uint64_t num = 200000;
+    tf::RingBuffer ring(4096);
+    ring.init();
+
+    std::thread producer([&ring]{
+        for (uint64_t i=0; i<num; )
+        {
+            if (ring.write(reinterpret_cast<const char*>(&i), sizeof(i)))
+            {
+                if (++i % 16 == 0) ring.commit();
+            }
+            else
+            {
+                ring.commit();
+                std::this_thread::yield();
+            }
+        }
+        ring.commit();
+    });
+
+    uint64_t mismatch = 0;
+    for (uint64_t i=0; i<num; )
+    {
+        uint64_t value;
+        if (ring.read(reinterpret_cast<char*>(&value), sizeof(value)))
+        {
+            mismatch += value != i++;
+            ring.commitRead();
+        }
+        else
+        {
+            std::this_thread::yield();
+        }
+    }
+    producer.join();
+    REQUIRE(mismatch == 0);
+    REQUIRE(ring.empty());
+}
+
+TEST_CASE( "RingBuffer Reserve Publish Messages", "[RingBuffer]" ) {
+    tf::RingBuffer ring(128);
+    ring.init();
+    REQUIRE(ring.peek().data() == nullptr);
+    REQUIRE(ring.reserve(65) == nullptr);
+
+    // Messages are written in place, the last one shorter than reserved
+    char* front = ring.reserve(20);
+    for (size_t i=0; i<3; ++i)
+    {
+        char* p = ring.reserve(20);
+        REQUIRE(p != nullptr);
+        std::memset(p, 'a'+i, 20);
+        if (i < 2) ring.publish(); else ring.publish(10);
+    }
+    for (size_t i=0; i<3; ++i)
+    {
+        std::string_view msg = ring.peek();
+        REQUIRE(msg == std::string(i < 2 ? 20 : 10, 'a'+i));
+        ring.consume();
+    }
+    REQUIRE(ring.peek().data() == nullptr);
+
+    // 88 bytes were used, a 48 byte record does not fit in the 40 byte
+    // tail and goes to the front after a padding record
+    char* p = ring.reserve(40);
+    REQUIRE(p == front);
+    std::memset(p, 'z', 40);
+    ring.publish();
+    std::string_view msg = ring.peek();
+    REQUIRE(msg == std::string(40, 'z'));
+    ring.consume();
+    REQUIRE(ring.freeSpace() == 128);
+}
+
+TEST_CASE( "RingBuffer Messages Between Threads", "[RingBuffer]" ) {
+    constexpr uint32_t num = 100000;
+    tf::RingBuffer ring(4096);
+    ring.init();
+
+    std::thread producer([&ring]{
+        for (uint32_t i=0; i<num; )
+        {
+            // Messages of 4 to 503 bytes, each word holding the sequence
+            size_t len = 4*(1 + i%126);
+            if (char* p = ring.reserve(len))
+            {
+                for (size_t k=0; k<len; k+=4) std::memcpy(p+k, &i, 4);
+                ring.publish();
+                ++i;
+            }
+            else
+            {
+                std::this_thread::yield();
+            }
+        }
+    });
+
+    uint32_t bad = 0;
+    for (uint32_t i=0; i<num; )
+    {
+        std::string_view msg = ring.peek();
+        if (msg.data() == nullptr)
+        {
+            std::this_thread::yield();
+            continue;
+        }
+        bad += msg.size() != 4*(1 + i%126);
+        for (size_t k=0; k<msg.size(); k+=4)
+        {
+            uint32_t value;
+            std::memcpy(&value, msg.data()+k, 4);
+            bad += value != i;
+        }
+        ring.consume();
+        ++i;
+    }
+    producer.join();
+    REQUIRE(bad == 0);
+}
+
+TEST_CASE( "RingBuffer Mirrored Wrap", "[RingBuffer]" ) {
+    const size_t page_size = tf::MirroredMemory::pageSize();
+    tf::RingBuffer ring(page_size);
+    ring.initMirrored();
+    REQUIRE(ring.isMirrored());
+
+    // Data written across the end is one piece
+    std::string head(page_size - 100, 'h');
+    REQUIRE(ring.write(head.data(), head.size()));
+    ring.commit();
+    REQUIRE(ring.read(&head[0], head.size()));
+    ring.commitRead();
+    std::string block(300, 'b');
+    REQUIRE(ring.write(block.data(), block.size()));
+    ring.commit();
+    struct iovec iov[2];
+    REQUIRE(ring.fetch(iov) == 300);
+    REQUIRE(iov[0].iov_len == 300);
+    REQUIRE(iov[1].iov_len == 0);
+    REQUIRE(std::string(static_cast<char*>(iov[0].iov_base), 300) == block);
+    ring.skip(300);
+    ring.commitRead();
+
+    // A message can take the whole ring and wraps without padding
+    char* p = ring.reserve(page_size - 8);
+    REQUIRE(p != nullptr);
+    std::memset(p, 'm', page_size - 8);
+    ring.publish();
+    REQUIRE(ring.peek() == std::string(page_size - 8, 'm'));
+    ring.consume();
+
+    tf::RingBuffer small(page_size/2);
+    REQUIRE_THROWS(small.initMirrored());
+}
+
+TEST_CASE( "RingBuffer Mirrored Shared Memory", "[RingBuffer]" ) {
+    const size_t page_size = tf::MirroredMemory::pageSize();
+    std::string name = "tf_ring_test_" + std::to_string(::getpid());
+    tf::RingBuffer producer(page_size);
+    producer.initMirrored(name, true);
+    tf::RingBuffer consumer(page_size);
+    consumer.initMirrored(name, false);
+
+    for (size_t i=0; i<10; ++i)
+    {
+        std::string msg(page_size/3, char('a'+i));
+        char* p = producer.reserve(msg.size());
+        REQUIRE(p != nullptr);
+        std::memcpy(p, msg.data(), msg.size());
+        producer.publish();
+        REQUIRE(consumer.peek() == msg);
+        consumer.consume();
+    }
+
+    tf::RingBuffer other(page_size*2);
+    REQUIRE_THROWS(other.initMirrored(name, false));
+}
+
+TEST_CASE( "RingBuffer Drain And Fill File", "[RingBuffer]" ) {
+    char path[] = "/tmp/tf_ring_testXXXXXX";
+    int fd = ::mkstemp(path);
+    REQUIRE(fd >= 0);
+    ::unlink(path);
+
+    // The data wraps, so it goes out in two pieces with one pwritev
+    tf::RingBuffer out(64);
+    out.init();
+    std::string skipped(40, 's');
+    REQUIRE(out.write(skipped.data(), skipped.size()));
+    out.commit();
+    REQUIRE(out.read(&skipped[0], skipped.size()));
+    out.commitRead();
+    std::string data;
+    for (size_t i=0; i<50; ++i) data += char('A' + i%26);
+    REQUIRE(out.write(data.data(), data.size()));
+    out.commit();
+    REQUIRE(out.drainTo(fd, 0) == 50);
+    REQUIRE(out.empty());
+    REQUIRE(out.freeSpace() == 64);
+
+    // Read back in two rounds through a ring smaller than the file
+    tf::RingBuffer in(32);
+    in.init();
+    std::string result(50, ' ');
+    REQUIRE(in.fillFrom(fd, 0) == 32);
+    REQUIRE(in.fillFrom(fd, 32) == 0);
+    REQUIRE(in.read(&result[0], 32));
+    in.commitRead();
+    REQUIRE(in.fillFrom(fd, 32) == 18);
+    REQUIRE(in.read(&result[32], 18));
+    REQUIRE(result == data);
+    ::close(fd);
+}
+
+TEST_CASE( "RingBuffer Drain To Pipe", "[RingBuffer]" ) {
+    int fds[2];
+    REQUIRE(::pipe(fds) == 0);
+    tf::RingBuffer ring(4096);
+    ring.init();
+    std::string data(3000, 'p');
+    REQUIRE(ring.write(data.data(), data.size()));
+    ring.commit();
+    REQUIRE(ring.drainTo(fds[1]) == 3000);
+
+    tf::RingBuffer in(4096);
+    in.init();
+    REQUIRE(in.fillFrom(fds[0]) == 3000);
+    REQUIRE(in.size() == 3000);
+    ::close(fds[0]);
+    ::close(fds[1]);
+}